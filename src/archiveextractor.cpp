@@ -0,0 +1,681 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "archiveextractor.h"
+#include "exception.h"
+#include "imagefile.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QHash>
+#include <QProcess>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QThread>
+
+#include <algorithm>
+#include <mutex>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr int DefaultScratchLimit = 16384; // MiB
+    constexpr int PollInterval = 100; // ms
+    constexpr qint64 PendingTimeout = 60 * 60; // Seconds
+
+    constexpr const char* ArchiveScratchLimitKey = "archiveScratchLimit";
+
+    constexpr const char* PendingMarker = ".pending";
+    constexpr const char* SourceFile = ".source";
+
+    struct Format
+    {
+        const char* suffix;
+        const char* compression;
+        bool sequential; // Members can only be reached by reading everything before them
+    };
+
+    constexpr Format Formats[] = {
+        { ".zip", "", false }, { ".7z", "", false }, { ".tar", "", true },
+        { ".tar.gz", "gz", true }, { ".tgz", "gz", true },
+        { ".tar.xz", "xz", true }, { ".txz", "xz", true },
+        { ".tar.zst", "zst", true }, { ".tzst", "zst", true },
+        { ".tar.bz2", "bz2", true }, { ".tbz2", "bz2", true }
+    };
+
+    // Listings by the identity of the archive, reading a compressed tarball takes a while
+    QHash<QString, QStringList> Listings;
+    std::mutex ListingsMutex;
+
+    auto formatOf(const QString& filename) -> const Format*
+    {
+        const QString name = filename.toLower();
+
+        for (const Format& format : Formats)
+        {
+            if (name.endsWith(format.suffix))
+                return &format;
+        }
+
+        return nullptr;
+    }
+
+    auto decompressor(const QString& compression) -> QStringList
+    {
+        // Only xz streams with several blocks and bzip2 via lbzip2 are decoded in parallel, zstd
+        // and gzip decode on one thread, pigz merely reads, writes and checks on others
+        if (compression == "xz")
+            return { "xz", "--decompress", "--stdout", "--threads=0" };
+
+        if (compression == "zst")
+            return { "zstd", "--decompress", "--stdout" };
+
+        if (compression == "bz2")
+        {
+            if (!QStandardPaths::findExecutable("lbzip2").isEmpty())
+                return { "lbzip2", "--decompress", "--stdout" };
+
+            return { "bzip2", "--decompress", "--stdout" };
+        }
+
+        if (!QStandardPaths::findExecutable("pigz").isEmpty())
+            return { "pigz", "--decompress", "--stdout" };
+
+        return { "gzip", "--decompress", "--stdout" };
+    }
+
+    auto sevenZip() -> QString
+    {
+        for (const char* name : { "7zz", "7z" })
+        {
+            const QString path = QStandardPaths::findExecutable(name);
+
+            if (!path.isEmpty())
+                return path;
+        }
+
+        return QString();
+    }
+
+    auto pattern(const QString& member) -> QString
+    {
+        // bsdtar takes members as wildcard patterns
+        QString escaped;
+
+        for (const QChar c : member)
+        {
+            if (c == '*' || c == '?' || c == '[' || c == ']' || c == '\\')
+                escaped += '\\';
+
+            escaped += c;
+        }
+
+        return escaped;
+    }
+
+    auto companions(const QString& image, const QStringList& files) -> QStringList
+    {
+        // Files next to the image with the same name, e.g. the MDF of an MDS
+        const QString base = image.left(image.size() - QFileInfo(image).suffix().size());
+
+        QStringList members;
+
+        for (const QString& file : files)
+        {
+            const QString suffix = file.mid(base.size());
+
+            if (file != image && file.startsWith(base, Qt::CaseInsensitive) &&
+                !suffix.contains('/') && !suffix.contains('.'))
+            {
+                members << file;
+            }
+        }
+
+        return members;
+    }
+
+    auto candidates(const QString& image, const QStringList& files) -> QStringList
+    {
+        // Track files a CUE or TOC may name, unless they obviously belong to another descriptor
+        static const QStringList Descriptors = { "cue", "toc", "ccd", "mds" };
+        static const QStringList Tracks = { "bin", "img", "iso", "raw", "wav", "sub" };
+
+        const QFileInfo info(image);
+
+        if (info.suffix().compare("cue", Qt::CaseInsensitive) != 0 &&
+            info.suffix().compare("toc", Qt::CaseInsensitive) != 0)
+        {
+            return QStringList();
+        }
+
+        const QString stem = image.left(image.lastIndexOf('.'));
+
+        QStringList others;
+
+        for (const QString& file : files)
+        {
+            if (file != image && QFileInfo(file).path() == info.path() &&
+                Descriptors.contains(QFileInfo(file).suffix().toLower()))
+            {
+                others << file.left(file.lastIndexOf('.'));
+            }
+        }
+
+        QStringList members;
+
+        for (const QString& file : files)
+        {
+            if (QFileInfo(file).path() != info.path() ||
+                !Tracks.contains(QFileInfo(file).suffix().toLower()))
+            {
+                continue;
+            }
+
+            const bool claimed = std::any_of(others.cbegin(), others.cend(),
+                                             [&file](const QString& other) {
+                return file.startsWith(other, Qt::CaseInsensitive);
+            });
+
+            if (!claimed || file.startsWith(stem, Qt::CaseInsensitive))
+                members << file;
+        }
+
+        return members;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+ArchiveExtractor::ArchiveExtractor(QObject* parent)
+    : QObject(parent) {}
+
+// ---------------------------------------------------------------------------------------------- //
+
+ArchiveExtractor::~ArchiveExtractor()
+{
+    if (m_thread)
+    {
+        m_thread->wait();
+        delete m_thread;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ArchiveExtractor::start(const QString& filename)
+{
+    Q_ASSERT(!isRunning());
+
+    delete m_thread;
+
+    m_thread = QThread::create([this, filename] {
+        QString extractedFile;
+        QString error;
+
+        try {
+            extractedFile = extract(filename);
+        }
+        catch (const Exception& e) {
+            error = QString::fromLocal8Bit(e.what());
+        }
+
+        emit finished(filename, extractedFile, error);
+    });
+
+    m_thread->start();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::isRunning() const -> bool
+{
+    return m_thread && m_thread->isRunning();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::isArchive(const QString& filename) -> bool
+{
+    return formatOf(filename) != nullptr;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::isArchiveImage(const QString& filename) -> bool
+{
+    // Also true for the archive alone, which still needs an image to be chosen
+    return isArchive(archivePath(filename));
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::archivePath(const QString& filename) -> QString
+{
+    // E.g. "games.zip:disc/image.cue", colons may also be part of the path
+    int colon = filename.indexOf(':');
+
+    while (colon >= 0)
+    {
+        const QString archive = filename.left(colon);
+
+        if (isArchive(archive))
+            return archive;
+
+        colon = filename.indexOf(':', colon + 1);
+    }
+
+    return filename;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::entryPath(const QString& filename) -> QString
+{
+    const QString archive = archivePath(filename);
+    return archive.size() < filename.size() ? filename.mid(archive.size() + 1) : QString();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::join(const QString& archive, const QString& entry) -> QString
+{
+    return archive + ':' + entry;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::images(const QString& archive) -> QStringList
+{
+    static const QStringList Descriptors = { "cue", "toc", "ccd" };
+
+    const QStringList files = entries(archive);
+    QStringList images;
+
+    for (const QString& file : files)
+    {
+        if (!ImageFile::hasImageSuffix(file))
+            continue;
+
+        const QString suffix = QFileInfo(file).suffix().toLower();
+
+        // Track data belongs to the descriptor next to it, like with ImageFile::isImage()
+        if (suffix == "bin" || suffix == "img" || suffix == "sub")
+        {
+            const QString base = file.left(file.size() - suffix.size());
+
+            const bool described = std::any_of(files.cbegin(), files.cend(),
+                                               [&base](const QString& other) {
+                return other.startsWith(base, Qt::CaseInsensitive) &&
+                       Descriptors.contains(other.mid(base.size()).toLower());
+            });
+
+            if (described)
+                continue;
+        }
+
+        images << file;
+    }
+
+    return images;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::scratchLimit() -> int
+{
+    QSettings settings;
+    return settings.value(ArchiveScratchLimitKey, DefaultScratchLimit).toInt();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ArchiveExtractor::setScratchLimit(int megabytes)
+{
+    QSettings settings;
+    settings.setValue(ArchiveScratchLimitKey, megabytes);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::scratchUsage() -> qint64
+{
+    qint64 usage = 0;
+
+    QDirIterator it(directory(), QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+
+    while (it.hasNext())
+    {
+        it.next();
+        usage += it.fileInfo().size();
+    }
+
+    return usage;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::extract(const QString& filename) -> QString
+{
+    const QString archive = archivePath(filename);
+    const QString image = entryPath(filename);
+
+    if (!QFileInfo::exists(archive))
+        throw Exception(Error::FileNotFound);
+
+    const QStringList files = entries(archive);
+
+    if (image.isEmpty() || !files.contains(image))
+        throw Exception(Error::ImageNotInArchive);
+
+    if (scratchUsage() >= qint64(scratchLimit()) * 1024 * 1024)
+        throw Exception(Error::ScratchSpaceExhausted);
+
+    if (!QDir().mkpath(directory()))
+        throw Exception(Error::ExtractionFailed);
+
+    // Removed again if anything goes wrong while extracting
+    QTemporaryDir scratch(directory() + "/XXXXXX");
+
+    if (!scratch.isValid())
+        throw Exception(Error::ExtractionFailed);
+
+    QFile marker(scratch.filePath(PendingMarker));
+    marker.open(QIODevice::WriteOnly);
+
+    QFile source(scratch.filePath(SourceFile));
+
+    if (source.open(QIODevice::WriteOnly))
+        source.write(filename.toUtf8());
+
+    const QStringList members = QStringList(image) + companions(image, files);
+
+    // Descriptors name their track files, which are only known once they've been extracted. A
+    // tarball would have to be read a second time for them, so whatever they may name comes along.
+    QStringList extras;
+
+    if (formatOf(archive)->sequential)
+    {
+        for (const QString& candidate : candidates(image, files))
+        {
+            if (!members.contains(candidate))
+                extras << candidate;
+        }
+    }
+
+    run(archive, members + extras, scratch.path());
+
+    const QString extractedFile = scratch.filePath(image);
+
+    if (!QFile::exists(extractedFile))
+        throw Exception(Error::ExtractionFailed);
+
+    QStringList referenced;
+    QStringList tracks;
+
+    for (const QString& track : ImageFile::trackFiles(extractedFile))
+    {
+        const QString member = QDir(scratch.path()).relativeFilePath(track);
+        referenced << member;
+
+        if (!QFile::exists(track) && files.contains(member))
+            tracks << member;
+    }
+
+    // Only left for names that couldn't be guessed, e.g. tracks in another directory
+    if (!tracks.isEmpty())
+        run(archive, tracks, scratch.path());
+
+    for (const QString& extra : extras)
+    {
+        if (!referenced.contains(extra))
+            QFile::remove(scratch.filePath(extra));
+    }
+
+    scratch.setAutoRemove(false);
+
+    return extractedFile;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ArchiveExtractor::commit(const QString& extractedFile)
+{
+    const QString path = scratchDirectory(extractedFile);
+
+    if (!path.isEmpty())
+        QFile::remove(path + "/" + PendingMarker);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ArchiveExtractor::discard(const QString& extractedFile)
+{
+    const QString path = scratchDirectory(extractedFile);
+
+    if (!path.isEmpty())
+        QDir(path).removeRecursively();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::hasExtractedImages() -> bool
+{
+    return !QDir(directory()).entryList(QDir::Dirs | QDir::NoDotAndDotDot).isEmpty();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::isExtracted(const QString& filename) -> bool
+{
+    return !scratchDirectory(filename).isEmpty() && QFile::exists(filename);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::originalPath(const QString& filename) -> QString
+{
+    const QString path = scratchDirectory(filename);
+
+    if (path.isEmpty())
+        return filename;
+
+    QFile source(path + "/" + SourceFile);
+
+    if (!source.open(QIODevice::ReadOnly))
+        return filename;
+
+    return QString::fromUtf8(source.readAll());
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ArchiveExtractor::release(const QStringList& loadedFiles)
+{
+    const QDir base(directory());
+
+    for (const QString& name : base.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        const QString path = base.absoluteFilePath(name);
+
+        // Still being extracted or just about to be mounted
+        const QFileInfo pending(path + "/" + PendingMarker);
+
+        if (pending.exists() &&
+            pending.lastModified().secsTo(QDateTime::currentDateTime()) < PendingTimeout)
+            continue;
+
+        const bool loaded = std::any_of(loadedFiles.cbegin(), loadedFiles.cend(),
+                                        [&path](const QString& file) {
+            return scratchDirectory(file) == path;
+        });
+
+        if (!loaded)
+            QDir(path).removeRecursively();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::entries(const QString& archive) -> QStringList
+{
+    const QString identity = ImageFile::identity(archive);
+
+    if (identity.isEmpty())
+        throw Exception(Error::FileNotFound);
+
+    {
+        std::lock_guard<std::mutex> lock(ListingsMutex);
+
+        if (Listings.contains(identity))
+            return Listings.value(identity);
+    }
+
+    // libarchive reads all of these formats
+    QProcess process;
+    process.setStandardErrorFile(QProcess::nullDevice());
+    process.start("bsdtar", { "-t", "-f", archive });
+
+    const bool success = process.waitForFinished(-1) &&
+                         process.exitStatus() == QProcess::NormalExit &&
+                         process.exitCode() == 0;
+
+    if (!success)
+        throw Exception(Error::FileNotReadable);
+
+    QStringList files;
+
+    for (const QByteArray& line : process.readAllStandardOutput().split('\n'))
+    {
+        const QString name = QString::fromLocal8Bit(line);
+
+        if (!name.isEmpty() && !name.endsWith('/'))
+            files << name;
+    }
+
+    std::lock_guard<std::mutex> lock(ListingsMutex);
+    Listings.insert(identity, files);
+
+    return files;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ArchiveExtractor::run(const QString& archive, const QStringList& members,
+                           const QString& target)
+{
+    const Format* format = formatOf(archive);
+    Q_ASSERT(format != nullptr);
+
+    const QString compression = format->compression;
+    const QString sevenZipPath = sevenZip();
+
+    QProcess decompression;
+    QProcess extraction;
+
+    decompression.setStandardErrorFile(QProcess::nullDevice());
+    extraction.setStandardOutputFile(QProcess::nullDevice());
+    extraction.setStandardErrorFile(QProcess::nullDevice());
+
+    QStringList patterns;
+
+    for (const QString& member : members)
+        patterns << pattern(member);
+
+    if (!compression.isEmpty())
+    {
+        // Decompressed by a separate tool and streamed into bsdtar, nothing else hits the disk
+        const QStringList command = decompressor(compression);
+
+        decompression.setStandardOutputProcess(&extraction);
+
+        extraction.start("bsdtar", QStringList { "-x", "-f", "-", "-C", target, "--" } + patterns);
+        decompression.start(command.first(), command.mid(1) << archive);
+    }
+    else if (!sevenZipPath.isEmpty() && !archive.endsWith(".tar", Qt::CaseInsensitive))
+    {
+        // Uses all cores, -spd takes the names literally
+        extraction.start(sevenZipPath, QStringList { "x", "-y", "-bd", "-spd", "-mmt=on",
+                                                     "-o" + target, "--", archive } + members);
+    }
+    else
+    {
+        extraction.start("bsdtar",
+                         QStringList { "-x", "-f", archive, "-C", target, "--" } + patterns);
+    }
+
+    const qint64 limit = qint64(scratchLimit()) * 1024 * 1024;
+
+    // The scratch area is bounded while extracting, the uncompressed sizes may be unknown
+    while (!extraction.waitForFinished(PollInterval) && extraction.state() != QProcess::NotRunning)
+    {
+        if (scratchUsage() > limit)
+        {
+            decompression.kill();
+            extraction.kill();
+
+            decompression.waitForFinished();
+            extraction.waitForFinished();
+
+            throw Exception(Error::ScratchSpaceExhausted);
+        }
+    }
+
+    bool success = extraction.exitStatus() == QProcess::NormalExit && extraction.exitCode() == 0;
+
+    if (!compression.isEmpty())
+    {
+        success = success && decompression.waitForFinished(-1) &&
+                  decompression.exitStatus() == QProcess::NormalExit &&
+                  decompression.exitCode() == 0;
+    }
+
+    if (!success)
+        throw Exception(Error::ExtractionFailed);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::directory() -> QString
+{
+    // Images can be large, so unlike RAM staging this lives on the disk
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/archives";
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ArchiveExtractor::scratchDirectory(const QString& extractedFile) -> QString
+{
+    if (extractedFile.isEmpty())
+        return QString();
+
+    const QString relative = QDir(directory()).relativeFilePath(extractedFile);
+
+    if (relative.startsWith("..") || QFileInfo(relative).isAbsolute() || !relative.contains('/'))
+        return QString();
+
+    return directory() + "/" + relative.section('/', 0, 0);
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,79 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef ARCHIVEEXTRACTOR_H
+#define ARCHIVEEXTRACTOR_H
+
+#include <QObject>
+#include <QStringList>
+
+class QThread;
+
+class ArchiveExtractor : public QObject
+{
+    Q_OBJECT
+
+public:
+    ArchiveExtractor(QObject* parent = nullptr);
+    ~ArchiveExtractor() override;
+
+    void start(const QString& filename);
+    auto isRunning() const -> bool;
+
+    static auto isArchive(const QString& filename) -> bool;
+    static auto isArchiveImage(const QString& filename) -> bool;
+
+    static auto archivePath(const QString& filename) -> QString;
+    static auto entryPath(const QString& filename) -> QString;
+    static auto join(const QString& archive, const QString& entry) -> QString;
+
+    static auto images(const QString& archive) -> QStringList;
+
+    static auto scratchLimit() -> int;
+    static void setScratchLimit(int megabytes);
+    static auto scratchUsage() -> qint64;
+
+    static auto extract(const QString& filename) -> QString;
+
+    static void commit(const QString& extractedFile);
+    static void discard(const QString& extractedFile);
+
+    static auto hasExtractedImages() -> bool;
+    static auto isExtracted(const QString& filename) -> bool;
+    static auto originalPath(const QString& filename) -> QString;
+
+    static void release(const QStringList& loadedFiles);
+
+signals:
+    void finished(const QString& filename, const QString& extractedFile, const QString& error);
+
+private:
+    static auto entries(const QString& archive) -> QStringList;
+    static void run(const QString& archive, const QStringList& members, const QString& target);
+
+    static auto directory() -> QString;
+    static auto scratchDirectory(const QString& extractedFile) -> QString;
+
+private:
+    QThread* m_thread = nullptr;
+};
+
+#endif // ARCHIVEEXTRACTOR_H
@@ -0,0 +1,505 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "batchsession.h"
+#include "imagecache.h"
+#include "imageverifier.h"
+#include "mountjournal.h"
+#include "ramstaging.h"
+
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QProcess>
+#include <QSocketNotifier>
+
+#include <memory>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr const char* StandardInput = "-";
+
+    constexpr int ReadSize = 64 * 1024;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+BatchSession::BatchSession(const CDEmu& cdemu, QObject* parent)
+    : QObject(parent),
+      m_cdemu(cdemu)
+{
+    m_output.open(STDOUT_FILENO, QIODevice::WriteOnly);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+BatchSession::~BatchSession()
+{
+    delete m_notifier;
+
+    if (m_descriptor > STDIN_FILENO)
+        close(m_descriptor);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto BatchSession::start(const QString& source) -> bool
+{
+    if (!m_cdemu.isDaemonRunning())
+        throw Exception(Error::DaemonNotRunning);
+
+    if (source == StandardInput)
+        m_descriptor = STDIN_FILENO;
+    else
+        m_descriptor = open(QFile::encodeName(source).constData(), O_RDONLY | O_CLOEXEC);
+
+    if (m_descriptor < 0)
+        return false;
+
+    // Devices are picked from this list, so pipelined mounts don't end up on the same device
+    reloadDevices();
+
+    m_notifier = new QSocketNotifier(m_descriptor, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &BatchSession::onReadyRead);
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void BatchSession::onReadyRead()
+{
+    // Only one read per notification, so a terminal or pipe never blocks the event loop
+    char buffer[ReadSize];
+    const ssize_t length = read(m_descriptor, buffer, sizeof(buffer));
+
+    if (length < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+
+    if (length > 0)
+        m_buffer.append(buffer, length);
+    else
+    {
+        m_notifier->setEnabled(false);
+        m_eof = true;
+
+        // The last line doesn't need a newline
+        if (!m_buffer.isEmpty())
+            m_buffer.append('\n');
+    }
+
+    int start = 0;
+
+    for (int end = m_buffer.indexOf('\n'); end >= 0; end = m_buffer.indexOf('\n', start))
+    {
+        m_lines << QString::fromUtf8(m_buffer.constData() + start, end - start).trimmed();
+        start = end + 1;
+    }
+
+    m_buffer.remove(0, start);
+
+    processLines();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void BatchSession::processLines()
+{
+    // Replies that complete right away would otherwise start processing again
+    if (m_processing)
+        return;
+
+    m_processing = true;
+
+    while (!m_waiting && !m_lines.isEmpty())
+    {
+        const QString line = m_lines.takeFirst();
+
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        // Something went wrong before, so the devices are looked up again once nothing is pending
+        if (m_stale && m_commands.isEmpty())
+        {
+            try {
+                reloadDevices();
+            }
+            catch (const Exception&) {
+                // Commands will fail on their own
+            }
+        }
+
+        execute(QProcess::splitCommand(line));
+    }
+
+    m_processing = false;
+
+    if (m_eof && m_lines.isEmpty() && m_commands.isEmpty() && !m_finished)
+    {
+        m_finished = true;
+        emit finished(m_failures);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void BatchSession::execute(const QStringList& arguments)
+{
+    const int id = m_nextId++;
+
+    Command command = { id, arguments.value(0).toLower(), QElapsedTimer(), QJsonObject(), false };
+    command.timer.start();
+
+    m_commands << command;
+
+    try {
+        if (command.name == "mount")
+            mount(id, arguments);
+        else if (command.name == "unmount")
+            unmount(id, arguments);
+        else if (command.name == "status")
+            status(id);
+        else if (command.name == "devices")
+            setDeviceCount(id, arguments);
+        else if (command.name == "wait")
+        {
+            // Nothing else is sent until everything before has been answered
+            m_waiting = true;
+            flush();
+        }
+        else
+            throw Exception(Error::InvalidCommand);
+    }
+    catch (const Exception& e) {
+        fail(id, e.what());
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void BatchSession::mount(int id, const QStringList& arguments)
+{
+    if (arguments.size() < 2 || arguments.size() > 3)
+        throw Exception(Error::InvalidCommand);
+
+    const QString path = QDir().absoluteFilePath(arguments.at(1));
+
+    if (!QFile::exists(path))
+        throw Exception(Error::FileNotFound);
+
+    // Verifying would stall every command behind this one, so only known results count
+    if (ImageVerifier::isRequired() && !ImageVerifier::isVerified(path))
+        throw Exception(Error::ImageNotVerified);
+
+    const QString image = ImageCache::resolve(path);
+
+    QList<Request> requests;
+    int index = -1;
+
+    if (arguments.size() == 3)
+    {
+        index = deviceIndex(arguments.at(2));
+
+        if (!m_devices.at(index).isEmpty())
+            throw Exception(Error::DeviceInUse);
+    }
+    else
+    {
+        index = m_devices.indexOf(QString());
+
+        // Requests are handled in order, so the new device exists by the time the image arrives
+        if (index < 0)
+        {
+            requests << [this](const CDEmu::Callback& callback) {
+                m_cdemu.requestAddDevice(this, callback);
+            };
+
+            index = m_devices.size();
+            m_devices << QString();
+        }
+    }
+
+    m_devices[index] = image;
+
+    requests << [this, image, index](const CDEmu::Callback& callback) {
+        m_cdemu.requestMount(image, index, this, callback);
+    };
+
+    await(requests, [this, id, index, image](const QList<QDBusMessage>& replies) {
+        const QString error = errorOf(replies);
+
+        if (!error.isEmpty())
+        {
+            fail(id, error);
+            return;
+        }
+
+        if (m_cdemu.address().isEmpty())
+            MountJournal::recordMount(index, image);
+
+        finish(id, { { "device", index } });
+    });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void BatchSession::unmount(int id, const QStringList& arguments)
+{
+    if (arguments.size() != 2)
+        throw Exception(Error::InvalidCommand);
+
+    const int index = deviceIndex(arguments.at(1));
+
+    m_devices[index].clear();
+
+    const Request request = [this, index](const CDEmu::Callback& callback) {
+        m_cdemu.requestUnmount(index, this, callback);
+    };
+
+    await({ request }, [this, id, index](const QList<QDBusMessage>& replies) {
+        const QString error = errorOf(replies);
+
+        if (!error.isEmpty())
+        {
+            fail(id, error);
+            return;
+        }
+
+        if (m_cdemu.address().isEmpty())
+            MountJournal::recordUnmount(index);
+
+        finish(id, { { "device", index } });
+    });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void BatchSession::status(int id)
+{
+    QList<Request> requests;
+
+    // Queued like the commands before it, so it sees their results
+    for (int i = 0; i < m_devices.size(); ++i)
+    {
+        requests << [this, i](const CDEmu::Callback& callback) {
+            m_cdemu.requestStatus(i, OperationScheduler::Bulk, this, callback);
+        };
+    }
+
+    await(requests, [this, id](const QList<QDBusMessage>& replies) {
+        QJsonArray devices;
+
+        for (int i = 0; i < replies.size(); ++i)
+        {
+            const CDEmu::Status status = CDEmu::toStatus(replies.at(i));
+
+            // Report the image that was asked for, not a cached or staged copy
+            const QString filename =
+                    ImageCache::originalPath(RamStaging::originalPath(status.fileName));
+
+            devices << QJsonObject {
+                { "device", i },
+                { "loaded", status.loaded },
+                { "file", status.loaded ? filename : QString() },
+                { "ram", status.loaded && RamStaging::isStaged(status.fileName) }
+            };
+        }
+
+        finish(id, { { "devices", devices } });
+    });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void BatchSession::setDeviceCount(int id, const QStringList& arguments)
+{
+    bool ok = false;
+    const int count = arguments.value(1).toInt(&ok);
+
+    if (arguments.size() != 2 || !ok || count < 0)
+        throw Exception(Error::InvalidCommand);
+
+    QList<Request> requests;
+
+    while (m_devices.size() < count)
+    {
+        requests << [this](const CDEmu::Callback& callback) {
+            m_cdemu.requestAddDevice(this, callback);
+        };
+
+        m_devices << QString();
+    }
+
+    // The daemon always removes the last device
+    while (m_devices.size() > count)
+    {
+        requests << [this](const CDEmu::Callback& callback) {
+            m_cdemu.requestRemoveDevice(this, callback);
+        };
+
+        m_devices.removeLast();
+    }
+
+    await(requests, [this, id, count](const QList<QDBusMessage>& replies) {
+        const QString error = errorOf(replies);
+
+        if (!error.isEmpty())
+            fail(id, error);
+        else
+            finish(id, { { "count", count } });
+    });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void BatchSession::await(const QList<Request>& requests, const Completion& completion)
+{
+    if (requests.isEmpty())
+    {
+        completion(QList<QDBusMessage>());
+        return;
+    }
+
+    const auto replies = std::make_shared<QList<QDBusMessage>>(requests.size());
+    const auto remaining = std::make_shared<int>(requests.size());
+
+    // All requests are handed to the scheduler right away, which sends them in order
+    for (int i = 0; i < requests.size(); ++i)
+    {
+        requests.at(i)([completion, replies, remaining, i](const QDBusMessage& reply) {
+            (*replies)[i] = reply;
+
+            if (--*remaining == 0)
+                completion(*replies);
+        });
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void BatchSession::finish(int id, const QJsonObject& result)
+{
+    Q_ASSERT(!m_commands.isEmpty());
+
+    Command& command = m_commands[id - m_commands.first().id];
+
+    command.result = result;
+
+    if (!command.result.contains("ok"))
+        command.result.insert("ok", true);
+
+    command.result.insert("ms", command.timer.nsecsElapsed() / 1e6);
+    command.done = true;
+
+    flush();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void BatchSession::fail(int id, const QString& error)
+{
+    ++m_failures;
+    m_stale = true;
+
+    finish(id, { { "ok", false }, { "error", error } });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void BatchSession::flush()
+{
+    while (!m_commands.isEmpty())
+    {
+        Command& command = m_commands.first();
+
+        // A barrier is answered once everything before it has been written
+        if (!command.done && command.name == "wait")
+        {
+            command.result.insert("ok", true);
+            command.result.insert("ms", command.timer.nsecsElapsed() / 1e6);
+            command.done = true;
+        }
+
+        if (!command.done)
+            break;
+
+        QJsonObject line = command.result;
+        line.insert("id", command.id);
+        line.insert("command", command.name);
+
+        m_output.write(QJsonDocument(line).toJson(QJsonDocument::Compact) + '\n');
+        m_commands.removeFirst();
+    }
+
+    m_output.flush();
+
+    // Also notices the end of the input once the last reply is in
+    if (m_commands.isEmpty())
+    {
+        m_waiting = false;
+        processLines();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void BatchSession::reloadDevices()
+{
+    m_devices.clear();
+
+    for (const CDEmu::Status& status : m_cdemu.getStatuses())
+        m_devices << (status.loaded ? status.fileName : QString());
+
+    m_stale = false;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto BatchSession::deviceIndex(const QString& argument) const -> int
+{
+    bool ok = false;
+    const int index = argument.toInt(&ok);
+
+    if (!ok || index < 0 || index >= m_devices.size())
+        throw Exception(Error::DeviceNotAvailable);
+
+    return index;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto BatchSession::errorOf(const QList<QDBusMessage>& replies) -> QString
+{
+    for (const QDBusMessage& reply : replies)
+    {
+        if (reply.type() == QDBusMessage::ErrorMessage)
+            return reply.errorMessage();
+    }
+
+    return QString();
+}
+
+// ---------------------------------------------------------------------------------------------- //
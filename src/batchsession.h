@@ -0,0 +1,112 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef BATCHSESSION_H
+#define BATCHSESSION_H
+
+#include "cdemu.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonObject>
+#include <QObject>
+#include <QStringList>
+
+#include <functional>
+
+class QSocketNotifier;
+
+class BatchSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    BatchSession(const CDEmu& cdemu, QObject* parent = nullptr);
+    ~BatchSession() override;
+
+    auto start(const QString& source) -> bool;
+
+signals:
+    void finished(int failures);
+
+private slots:
+    void onReadyRead();
+
+private:
+    struct Command
+    {
+        int id;
+        QString name;
+        QElapsedTimer timer;
+        QJsonObject result;
+        bool done;
+    };
+
+    using Request = std::function<void(const CDEmu::Callback& callback)>;
+    using Completion = std::function<void(const QList<QDBusMessage>& replies)>;
+
+private:
+    void processLines();
+    void execute(const QStringList& arguments);
+
+    void mount(int id, const QStringList& arguments);
+    void unmount(int id, const QStringList& arguments);
+    void status(int id);
+    void setDeviceCount(int id, const QStringList& arguments);
+
+    void await(const QList<Request>& requests, const Completion& completion);
+
+    void finish(int id, const QJsonObject& result = QJsonObject());
+    void fail(int id, const QString& error);
+    void flush();
+
+    void reloadDevices();
+    auto deviceIndex(const QString& argument) const -> int;
+
+    static auto errorOf(const QList<QDBusMessage>& replies) -> QString;
+
+private:
+    const CDEmu& m_cdemu;
+
+    int m_descriptor = -1;
+    QSocketNotifier* m_notifier = nullptr;
+
+    QByteArray m_buffer;
+    QStringList m_lines;
+    QFile m_output;
+
+    // Commands in the order they were read, results are written in the same order
+    QList<Command> m_commands;
+    int m_nextId = 1;
+
+    // Image of each device as far as this session knows, including mounts still in flight
+    QStringList m_devices;
+    bool m_stale = false;
+
+    bool m_waiting = false;
+    bool m_processing = false;
+    bool m_eof = false;
+    bool m_finished = false;
+
+    int m_failures = 0;
+};
+
+#endif // BATCHSESSION_H
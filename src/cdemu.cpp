@@ -20,8 +20,19 @@
  ****************************************************************************/
 
 #include "cdemu.h"
+#include "eventtrace.h"
+#include "imagefile.h"
+#include "stalldetector.h"
+#include "trafficrecorder.h"
+
+#include <KLocalizedString>
 
 #include <QFile>
+#include <QPointer>
+#include <QTimer>
+
+#include <algorithm>
+#include <memory>
 
 // ---------------------------------------------------------------------------------------------- //
 
@@ -29,12 +40,109 @@ namespace {
     constexpr const char* ServiceName   = "net.sf.cdemu.CDEmuDaemon";
     constexpr const char* PathName      = "/Daemon";
     constexpr const char* InterfaceName = "net.sf.cdemu.CDEmuDaemon";
+
+    constexpr const char* SessionBusAddress = "session";
+    constexpr const char* SystemBusAddress  = "system";
+
+    constexpr const char* DeviceIdOption = "device-id";
+
+    const QStringList BoolOptions = {
+        "tr-emulation", "dpm-emulation", "bad-sector-emulation", "dvd-report-css"
+    };
+
+    auto toBool(const QVariant& value) -> bool
+    {
+        if (value.userType() != QMetaType::QString)
+            return value.toBool();
+
+        const QString text = value.toString().toLower();
+        return text == "1" || text == "true" || text == "on" || text == "yes";
+    }
+
+    auto fromDBus(const QVariant& argument) -> QVariant
+    {
+        QVariant value = argument;
+
+        if (value.userType() == qMetaTypeId<QDBusVariant>())
+            value = value.value<QDBusVariant>().variant();
+
+        // Structures like the device ID are flattened into comma separated strings
+        if (value.userType() == qMetaTypeId<QDBusArgument>())
+        {
+            const QDBusArgument structure = value.value<QDBusArgument>();
+
+            QStringList fields;
+
+            structure.beginStructure();
+
+            while (!structure.atEnd())
+            {
+                QString field;
+                structure >> field;
+                fields << field;
+            }
+
+            structure.endStructure();
+
+            return fields.join(',');
+        }
+
+        return value;
+    }
+
+    auto toDBus(const QString& name, const QVariant& value) -> QVariant
+    {
+        if (BoolOptions.contains(name))
+            return QVariant::fromValue(QDBusVariant(toBool(value)));
+
+        if (name == DeviceIdOption)
+        {
+            const QStringList fields = value.toString().split(',');
+
+            if (fields.size() != 4)
+                throw Exception(Error::InvalidOption);
+
+            QDBusArgument structure;
+            structure.beginStructure();
+
+            for (const QString& field : fields)
+                structure << field.trimmed();
+
+            structure.endStructure();
+
+            return QVariant::fromValue(QDBusVariant(QVariant::fromValue(structure)));
+        }
+
+        throw Exception(Error::InvalidOption);
+    }
+
+    auto busConnection(const QString& address) -> QDBusConnection
+    {
+        if (address.isEmpty() || address == SessionBusAddress)
+            return QDBusConnection::sessionBus();
+
+        if (address == SystemBusAddress)
+            return QDBusConnection::systemBus();
+
+        // A private connection per daemon, so a hung one doesn't hold up calls to the others
+        return QDBusConnection::connectToBus(address, "kde_cdemu:" + address);
+    }
+
+    auto countSucceeded(const QList<QDBusMessage>& replies) -> int
+    {
+        return int(std::count_if(replies.cbegin(), replies.cend(), [](const QDBusMessage& reply) {
+            return reply.type() == QDBusMessage::ReplyMessage;
+        }));
+    }
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-CDEmu::CDEmu()
-    : m_watcher(this)
+CDEmu::CDEmu(const QString& address)
+    : m_address(address == SessionBusAddress ? QString() : address),
+      m_connection(busConnection(address)),
+      m_watcher(this),
+      m_scheduler(m_connection)
 {
     connect(&m_watcher, SIGNAL(serviceRegistered(QString)),
             this,       SLOT(onServiceRegistered(QString)));
@@ -42,24 +150,77 @@ CDEmu::CDEmu()
     connect(&m_watcher, SIGNAL(serviceUnregistered(QString)),
             this,       SLOT(onServiceUnregistered(QString)));
 
-    m_watcher.setConnection(QDBusConnection::sessionBus());
+    m_watcher.setConnection(m_connection);
     m_watcher.addWatchedService(ServiceName);
 
-    QDBusConnection::sessionBus().interface()->startService(ServiceName);
+    if (m_connection.isConnected())
+        m_connection.interface()->startService(ServiceName);
 
     if (!isDaemonRunning())
         throw Exception(Error::DaemonNotRunning);
 
     connectMethod("DeviceAdded", SIGNAL(deviceAdded()));
     connectMethod("DeviceRemoved", SIGNAL(deviceRemoved()));
-    connectMethod("DeviceStatusChanged", SIGNAL(deviceChanged(int)));
+    connectMethod("DeviceStatusChanged", SLOT(onDeviceStatusChanged(int)));
+    connectMethod("DeviceMappingsReady", SIGNAL(mappingsReady()));
+
+    // Part of what --record captures, together with the calls made through the scheduler
+    connect(this, &CDEmu::deviceAdded, this, [] {
+        TrafficRecorder::recordSignal("DeviceAdded");
+    });
+    connect(this, &CDEmu::deviceRemoved, this, [] {
+        TrafficRecorder::recordSignal("DeviceRemoved");
+    });
+    connect(this, &CDEmu::mappingsReady, this, [] {
+        TrafficRecorder::recordSignal("DeviceMappingsReady");
+    });
+
+    // Device numbers shift when devices come and go
+    connect(this, SIGNAL(deviceAdded()), this, SLOT(clearMappings()));
+    connect(this, SIGNAL(deviceRemoved()), this, SLOT(clearMappings()));
+    connect(this, SIGNAL(mappingsReady()), this, SLOT(clearMappings()));
+    connect(this, SIGNAL(daemonChanged(bool)), this, SLOT(clearMappings()));
+
+    connect(this, SIGNAL(deviceAdded()), this, SLOT(clearImages()));
+    connect(this, SIGNAL(deviceRemoved()), this, SLOT(clearImages()));
+    connect(this, SIGNAL(deviceChanged(int)), this, SLOT(clearImages()));
+    connect(this, SIGNAL(daemonChanged(bool)), this, SLOT(clearImages()));
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::address() const -> QString
+{
+    return m_address;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::displayName() const -> QString
+{
+    if (m_address.isEmpty())
+        return i18n("Session Bus");
+
+    if (m_address == SystemBusAddress)
+        return i18n("System Bus");
+
+    return m_address;
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
 auto CDEmu::isDaemonRunning() const -> bool
 {
-    return QDBusConnection::sessionBus().interface()->isServiceRegistered(ServiceName);
+    return m_connection.isConnected() &&
+           m_connection.interface()->isServiceRegistered(ServiceName);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::isResponsive() const -> bool
+{
+    // Registered, but not answering in time
+    return m_scheduler.isResponsive();
 }
 
 // ---------------------------------------------------------------------------------------------- //
@@ -91,32 +252,170 @@ auto CDEmu::getNextFreeDevice() const -> int
 
 // ---------------------------------------------------------------------------------------------- //
 
+auto CDEmu::getFreeDeviceCount() const -> int
+{
+    const int count = getDeviceCount();
+
+    // Ask for the state of all devices at once
+    QList<QDBusMessage> methods;
+
+    for (int i = 0; i < count; ++i)
+    {
+        QDBusMessage m = createMethodCall("DeviceGetStatus");
+        m << i;
+
+        methods << m;
+    }
+
+    int free = 0;
+
+    for (const QDBusMessage& reply : m_scheduler.callAll(methods, OperationScheduler::Interactive))
+    {
+        if (reply.type() == QDBusMessage::ReplyMessage && !reply.arguments().value(0).toBool())
+            ++free;
+    }
+
+    return free;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 auto CDEmu::getStatus(int index) const -> Status
 {
     QDBusMessage m = createMethodCall("DeviceGetStatus");
     m << index;
 
     try {
-        const QDBusMessage reply = callMethod(m);
+        return toStatus(callMethod(m));
+    }
+    catch (const Exception& e) {
+        qDebug() << "Unable to get device status:" << e.what();
+    }
+
+    return { false, QString() };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::getStatuses() const -> QList<Status>
+{
+    const int count = getDeviceCount();
+
+    // Ask for the state of all devices at once
+    QList<QDBusMessage> methods;
+
+    for (int i = 0; i < count; ++i)
+    {
+        QDBusMessage m = createMethodCall("DeviceGetStatus");
+        m << i;
+
+        methods << m;
+    }
+
+    QList<Status> statuses;
+
+    for (const QDBusMessage& reply : m_scheduler.callAll(methods, OperationScheduler::Interactive))
+        statuses << toStatus(reply);
 
-        const QList<QVariant> args = reply.arguments();
+    return statuses;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::requestDeviceCount() const -> QDBusPendingCall
+{
+    return m_scheduler.dispatch(createMethodCall("GetNumberOfDevices"));
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::requestStatus(int index) const -> QDBusPendingCall
+{
+    QDBusMessage m = createMethodCall("DeviceGetStatus");
+    m << index;
+
+    return m_scheduler.dispatch(m);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void CDEmu::requestStatus(int index, Priority priority, QObject* context,
+                          const Callback& callback) const
+{
+    QDBusMessage m = createMethodCall("DeviceGetStatus");
+    m << index;
+
+    m_scheduler.submit(m, priority, context, callback);
+}
+
+// ---------------------------------------------------------------------------------------------- //
 
-        const bool loaded = args.at(0).toBool();
-        const QList<QVariant> filenames = args.at(1).toList();
+void CDEmu::requestStatuses(QObject* context, const StatusCallback& callback) const
+{
+    m_scheduler.submit(createMethodCall("GetNumberOfDevices"), OperationScheduler::Interactive,
+                       context, [this, context, callback](const QDBusMessage& reply) {
+        if (reply.type() != QDBusMessage::ReplyMessage)
+        {
+            callback(false, {});
+            return;
+        }
 
-        if (loaded)
+        const int count = reply.arguments().value(0).toInt();
+
+        if (count == 0)
         {
-            if (filenames.empty()) // Shouldn't happen
-                throw Exception(Error::UnknownError);
+            callback(true, {});
+            return;
+        }
+
+        // All devices are asked at once, the callback runs when the last one has answered
+        auto statuses = std::make_shared<QList<Status>>(count);
+        auto pending = std::make_shared<int>(count);
+        auto answered = std::make_shared<bool>(true);
 
-            return { true, filenames.at(0).toString() };
+        for (int i = 0; i < count; ++i)
+        {
+            requestStatus(i, OperationScheduler::Interactive, context,
+                          [callback, statuses, pending, answered, i](const QDBusMessage& status) {
+                (*statuses)[i] = toStatus(status);
+                *answered &= status.type() == QDBusMessage::ReplyMessage;
+
+                if (--*pending == 0)
+                    callback(*answered, *statuses);
+            });
         }
-    }
-    catch (const Exception& e) {
-        qDebug() << "Unable to get device status:" << e.what();
-    }
+    });
+}
 
-    return { false, QString() };
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::toStatus(const QDBusMessage& reply) -> Status
+{
+    const QList<QVariant> args = reply.arguments();
+
+    if (reply.type() != QDBusMessage::ReplyMessage || args.size() < 2 || !args.at(0).toBool())
+        return { false, QString() };
+
+    const QList<QVariant> filenames = args.at(1).toList();
+
+    if (filenames.empty()) // Shouldn't happen
+        return { false, QString() };
+
+    return { true, filenames.at(0).toString() };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::errorOf(const QDBusMessage& reply) -> QString
+{
+    if (reply.type() != QDBusMessage::ErrorMessage)
+        return QString();
+
+    // What D-Bus says about a timeout doesn't tell the user which side gave up
+    if (OperationScheduler::isTimeout(reply))
+        return QString::fromLocal8Bit(Exception(Error::DaemonNotResponding).what());
+
+    return reply.errorMessage();
 }
 
 // ---------------------------------------------------------------------------------------------- //
@@ -137,6 +436,65 @@ auto CDEmu::getFileName(int index) const -> QString
 
 // ---------------------------------------------------------------------------------------------- //
 
+auto CDEmu::getLoadedFiles() const -> QStringList
+{
+    QStringList filenames;
+
+    for (const Status& status : getStatuses())
+    {
+        if (status.loaded)
+            filenames << status.fileName;
+    }
+
+    return filenames;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::getLoadedFiles(const QList<const CDEmu*>& endpoints) -> QStringList
+{
+    QStringList filenames;
+
+    for (const CDEmu* cdemu : endpoints)
+    {
+        if (cdemu->isDaemonRunning())
+            filenames << cdemu->getLoadedFiles();
+    }
+
+    return filenames;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::findImage(const QString& filename) const -> int
+{
+    // Matches the same file under any name, but not one that has been modified since
+    const QString identity = ImageFile::identity(filename);
+
+    if (identity.isEmpty())
+        return -1;
+
+    if (!m_imagesValid)
+    {
+        m_images.clear();
+
+        const QList<Status> statuses = getStatuses();
+
+        for (int i = 0; i < statuses.size(); ++i)
+        {
+            if (statuses.at(i).loaded)
+                m_images.insert(ImageFile::identity(statuses.at(i).fileName), i);
+        }
+
+        m_images.remove(QString());
+        m_imagesValid = true;
+    }
+
+    return m_images.value(identity, -1);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 void CDEmu::mount(const QString& filename, int index) const
 {
     if (!QFile::exists(filename))
@@ -156,6 +514,7 @@ void CDEmu::mount(const QString& filename, int index) const
     QDBusMessage m = createMethodCall("DeviceLoad");
     m << index << filenames << parameters;
 
+    m_imagesValid = false;
     callMethod(m);
 }
 
@@ -169,11 +528,262 @@ void CDEmu::unmount(int index) const
     QDBusMessage m = createMethodCall("DeviceUnload");
     m << index;
 
+    m_imagesValid = false;
     callMethod(m);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
+void CDEmu::swap(int index, const QString& filename) const
+{
+    if (!isDaemonRunning())
+        throw Exception(Error::DaemonNotRunning);
+
+    // Both requests go out back to back without looking at the device in between
+    QDBusMessage unload = createMethodCall("DeviceUnload");
+    unload << index;
+
+    QDBusMessage load = createMethodCall("DeviceLoad");
+    load << index << QStringList(filename) << QVariantMap();
+
+    const StallDetector::Operation operation("CDEmu::DeviceSwap");
+
+    EventTrace::begin("DeviceSwap", index);
+
+    m_imagesValid = false;
+
+    const QList<QDBusMessage> replies =
+            m_scheduler.callAll({ unload, load }, OperationScheduler::Interactive);
+
+    EventTrace::end("DeviceSwap", index);
+
+    // Unloading an empty device fails, which doesn't matter here
+    if (replies.at(1).type() != QDBusMessage::ReplyMessage)
+        throw Exception(Error::UnknownError);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void CDEmu::requestMount(const QString& filename, int index, QObject* context,
+                         const Callback& callback, Priority priority) const
+{
+    // Unlike mount(), the caller is responsible for picking a free device
+    QDBusMessage m = createMethodCall("DeviceLoad");
+    m << index << QStringList(filename) << QVariantMap();
+
+    m_imagesValid = false;
+    m_scheduler.submit(m, priority, context, callback);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void CDEmu::requestUnmount(int index, QObject* context, const Callback& callback,
+                           Priority priority) const
+{
+    QDBusMessage m = createMethodCall("DeviceUnload");
+    m << index;
+
+    m_imagesValid = false;
+    m_scheduler.submit(m, priority, context, callback);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void CDEmu::requestSwap(int index, const QString& filename, QObject* context,
+                        const Callback& callback) const
+{
+    // Like swap(), the callback gets the reply to loading the new image
+    QDBusMessage unload = createMethodCall("DeviceUnload");
+    unload << index;
+
+    QDBusMessage load = createMethodCall("DeviceLoad");
+    load << index << QStringList(filename) << QVariantMap();
+
+    EventTrace::begin("DeviceSwap", index);
+
+    m_imagesValid = false;
+
+    // The trace is closed even if the context is gone by then
+    const QPointer<QObject> guard(context);
+
+    m_scheduler.submit(unload, OperationScheduler::Interactive);
+    m_scheduler.submit(load, OperationScheduler::Interactive, &m_scheduler,
+                       [index, guard, callback](const QDBusMessage& reply) {
+        EventTrace::end("DeviceSwap", index);
+
+        if (guard)
+            callback(reply);
+    });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::getMapping(int index) const -> Mapping
+{
+    if (m_mappings.contains(index))
+        return m_mappings.value(index);
+
+    QDBusMessage m = createMethodCall("DeviceGetMapping");
+    m << index;
+
+    try {
+        const QList<QVariant> args = callMethod(m).arguments();
+
+        if (args.size() < 2)
+            throw Exception(Error::UnknownError);
+
+        // Empty until the kernel has created the nodes, "DeviceMappingsReady" clears the cache
+        const Mapping mapping = { args.at(0).toString(), args.at(1).toString() };
+        m_mappings.insert(index, mapping);
+
+        return mapping;
+    }
+    catch (const Exception& e) {
+        qDebug() << "Unable to get device mapping:" << e.what();
+    }
+
+    return { QString(), QString() };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::cachedMapping(int index) const -> Mapping
+{
+    if (m_mappings.contains(index))
+        return m_mappings.value(index);
+
+    // Never waits, the mapping is announced by mappingsUpdated() once the daemon has answered
+    if (!m_pendingMappings.contains(index) && isDaemonRunning() && isResponsive())
+    {
+        QDBusMessage m = createMethodCall("DeviceGetMapping");
+        m << index;
+
+        m_pendingMappings.insert(index);
+
+        const int generation = m_mappingGeneration;
+
+        m_scheduler.submit(m, OperationScheduler::Interactive, &m_scheduler,
+                           [this, index, generation](const QDBusMessage& reply) {
+            // Device numbers may have shifted in the meantime
+            if (generation != m_mappingGeneration)
+                return;
+
+            m_pendingMappings.remove(index);
+
+            const QList<QVariant> args = reply.arguments();
+
+            if (reply.type() != QDBusMessage::ReplyMessage || args.size() < 2)
+                return;
+
+            m_mappings.insert(index, { args.at(0).toString(), args.at(1).toString() });
+            emit const_cast<CDEmu*>(this)->mappingsUpdated();
+        });
+    }
+
+    return { QString(), QString() };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::getOptions(int index, const QStringList& names) const -> QVariantMap
+{
+    if (!isDaemonRunning())
+        throw Exception(Error::DaemonNotRunning);
+
+    // Send all requests before waiting for the first reply
+    QList<QDBusMessage> methods;
+
+    for (const QString& name : names)
+    {
+        QDBusMessage m = createMethodCall("DeviceGetOption");
+        m << index << name;
+
+        methods << m;
+    }
+
+    const QList<QDBusMessage> replies =
+            m_scheduler.callAll(methods, OperationScheduler::Interactive);
+
+    QVariantMap options;
+
+    for (int i = 0; i < replies.size(); ++i)
+    {
+        const QDBusMessage& reply = replies.at(i);
+
+        if (reply.type() == QDBusMessage::ReplyMessage && !reply.arguments().isEmpty())
+            options.insert(names.at(i), fromDBus(reply.arguments().at(0)));
+    }
+
+    return options;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void CDEmu::setOptions(int index, const QVariantMap& options) const
+{
+    if (!isDaemonRunning())
+        throw Exception(Error::DaemonNotRunning);
+
+    QList<QDBusMessage> methods;
+
+    for (auto it = options.cbegin(); it != options.cend(); ++it)
+    {
+        QDBusMessage m = createMethodCall("DeviceSetOption");
+        m << index << it.key() << toDBus(it.key(), it.value());
+
+        methods << m;
+    }
+
+    if (countSucceeded(m_scheduler.callAll(methods, OperationScheduler::Normal)) != methods.size())
+        throw Exception(Error::InvalidOption);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void CDEmu::requestOptions(int index, const QVariantMap& options, QObject* context,
+                           const std::function<void(bool success)>& callback) const
+{
+    QList<QDBusMessage> methods;
+
+    for (auto it = options.cbegin(); it != options.cend(); ++it)
+    {
+        QDBusMessage m = createMethodCall("DeviceSetOption");
+        m << index << it.key() << toDBus(it.key(), it.value());
+
+        methods << m;
+    }
+
+    // Called from the event loop either way
+    if (methods.isEmpty())
+    {
+        QTimer::singleShot(0, context, [callback] { callback(true); });
+        return;
+    }
+
+    auto pending = std::make_shared<int>(methods.size());
+    auto success = std::make_shared<bool>(true);
+
+    for (const QDBusMessage& m : std::as_const(methods))
+    {
+        m_scheduler.submit(m, OperationScheduler::Normal, context,
+                           [callback, pending, success](const QDBusMessage& reply) {
+            *success &= reply.type() == QDBusMessage::ReplyMessage;
+
+            if (--*pending == 0)
+                callback(*success);
+        });
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::optionNames() -> QStringList
+{
+    return QStringList(BoolOptions) << DeviceIdOption;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 auto CDEmu::addDevice() const -> int
 {
     callMethod("AddDevice");
@@ -182,13 +792,114 @@ auto CDEmu::addDevice() const -> int
 
 // ---------------------------------------------------------------------------------------------- //
 
+void CDEmu::addDevices(int count) const
+{
+    if (!isDaemonRunning())
+        throw Exception(Error::DaemonNotRunning);
+
+    // Requests are sent before waiting for the first reply, as many as the daemon keeps up with
+    const QList<QDBusMessage> methods(count, createMethodCall("AddDevice"));
+
+    if (countSucceeded(m_scheduler.callAll(methods, OperationScheduler::Bulk)) != count)
+        throw Exception(Error::UnknownError);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 void CDEmu::removeDevice() const
 {
+    m_imagesValid = false;
     callMethod("RemoveDevice");
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
+void CDEmu::requestAddDevice(QObject* context, const Callback& callback,
+                             Priority priority) const
+{
+    m_scheduler.submit(createMethodCall("AddDevice"), priority, context, callback);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void CDEmu::requestRemoveDevice(QObject* context, const Callback& callback,
+                                Priority priority) const
+{
+    m_imagesValid = false;
+    m_scheduler.submit(createMethodCall("RemoveDevice"), priority, context, callback);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::mountAll(const QMap<int, QString>& images) const -> int
+{
+    if (!isDaemonRunning())
+        throw Exception(Error::DaemonNotRunning);
+
+    // Unlike mount(), this doesn't check device states, it's meant for freshly started daemons
+    QList<QDBusMessage> methods;
+    m_imagesValid = false;
+
+    for (auto it = images.cbegin(); it != images.cend(); ++it)
+    {
+        if (!QFile::exists(it.value()))
+            continue;
+
+        QDBusMessage m = createMethodCall("DeviceLoad");
+        m << it.key() << QStringList(it.value()) << QVariantMap();
+
+        methods << m;
+    }
+
+    return countSucceeded(m_scheduler.callAll(methods, OperationScheduler::Bulk));
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::mostAvailable(const QList<const CDEmu*>& endpoints) -> const CDEmu*
+{
+    const CDEmu* best = nullptr;
+    int bestFree = -1;
+    bool hung = false;
+
+    // The first daemon wins ties, so it also gets new devices when all are full
+    for (const CDEmu* cdemu : endpoints)
+    {
+        if (!cdemu->isDaemonRunning())
+            continue;
+
+        // Waiting for one that hangs would hold up mounting on all others, asking may also be
+        // what shows that it hangs
+        const int free = cdemu->isResponsive() ? cdemu->getFreeDeviceCount() : 0;
+
+        if (!cdemu->isResponsive())
+        {
+            hung = true;
+            continue;
+        }
+
+        if (free > bestFree)
+        {
+            best = cdemu;
+            bestFree = free;
+        }
+    }
+
+    if (!best)
+        throw Exception(hung ? Error::DaemonNotResponding : Error::DaemonNotRunning);
+
+    return best;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto CDEmu::scheduler() const -> const OperationScheduler&
+{
+    return m_scheduler;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 void CDEmu::onServiceRegistered(const QString& service)
 {
     if (service == ServiceName)
@@ -205,9 +916,34 @@ void CDEmu::onServiceUnregistered(const QString& service)
 
 // ---------------------------------------------------------------------------------------------- //
 
+void CDEmu::onDeviceStatusChanged(int index)
+{
+    EventTrace::instant("DeviceStatusChanged", index);
+    TrafficRecorder::recordSignal("DeviceStatusChanged", { index });
+    emit deviceChanged(index);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void CDEmu::clearMappings()
+{
+    m_mappings.clear();
+    m_pendingMappings.clear();
+    ++m_mappingGeneration;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void CDEmu::clearImages()
+{
+    m_imagesValid = false;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 void CDEmu::connectMethod(const QString& name, const char* slot)
 {
-    QDBusConnection::sessionBus().connect(ServiceName, PathName, InterfaceName, name, this, slot);
+    m_connection.connect(ServiceName, PathName, InterfaceName, name, this, slot);
 }
 
 // ---------------------------------------------------------------------------------------------- //
@@ -217,7 +953,13 @@ auto CDEmu::callMethod(const QDBusMessage& method) const -> QDBusMessage
     if (!isDaemonRunning())
         throw Exception(Error::DaemonNotRunning);
 
-    const QDBusMessage reply = QDBusConnection::sessionBus().call(method);
+    const StallDetector::Operation operation("CDEmu::" + method.member());
+
+    // Traced by the scheduler like all other calls
+    const QDBusMessage reply = m_scheduler.call(method);
+
+    if (OperationScheduler::isTimeout(reply))
+        throw Exception(Error::DaemonNotResponding);
 
     if (reply.type() != QDBusMessage::ReplyMessage)
         throw Exception(Error::UnknownError);
@@ -23,6 +23,7 @@
 #define CDEMU_H
 
 #include "exception.h"
+#include "operationscheduler.h"
 
 #include <QtDBus>
 
@@ -37,35 +38,102 @@ public:
         QString fileName;
     };
 
+    struct Mapping
+    {
+        QString scsiCdRom;
+        QString scsiGeneric;
+    };
+
+    using Callback = OperationScheduler::Callback;
+    using Priority = OperationScheduler::Priority;
+    using StatusCallback = std::function<void(bool answered, const QList<Status>& statuses)>;
+
 public:
-    CDEmu();
+    explicit CDEmu(const QString& address = QString());
+
+    auto address() const -> QString;
+    auto displayName() const -> QString;
 
     auto isDaemonRunning() const -> bool;
+    auto isResponsive() const -> bool;
 
     auto getDeviceCount() const -> int;
     auto getNextFreeDevice() const -> int;
+    auto getFreeDeviceCount() const -> int;
 
     auto getStatus(int index) const -> Status;
+    auto getStatuses() const -> QList<Status>;
+
+    auto requestDeviceCount() const -> QDBusPendingCall;
+    auto requestStatus(int index) const -> QDBusPendingCall;
+    void requestStatus(int index, Priority priority, QObject* context,
+                       const Callback& callback) const;
+    void requestStatuses(QObject* context, const StatusCallback& callback) const;
+    static auto toStatus(const QDBusMessage& reply) -> Status;
+    static auto errorOf(const QDBusMessage& reply) -> QString;
 
     auto isLoaded(int index) const -> bool;
     auto getFileName(int index) const -> QString;
+    auto getLoadedFiles() const -> QStringList;
+
+    static auto getLoadedFiles(const QList<const CDEmu*>& endpoints) -> QStringList;
+
+    auto findImage(const QString& filename) const -> int;
+
+    auto getMapping(int index) const -> Mapping;
+    auto cachedMapping(int index) const -> Mapping;
 
     void mount(const QString& filename, int index) const;
     void unmount(int index) const;
+    void swap(int index, const QString& filename) const;
+
+    void requestMount(const QString& filename, int index, QObject* context = nullptr,
+                      const Callback& callback = Callback(),
+                      Priority priority = OperationScheduler::Bulk) const;
+    void requestUnmount(int index, QObject* context = nullptr,
+                        const Callback& callback = Callback(),
+                        Priority priority = OperationScheduler::Bulk) const;
+    void requestSwap(int index, const QString& filename, QObject* context,
+                     const Callback& callback) const;
+
+    auto getOptions(int index, const QStringList& names = optionNames()) const -> QVariantMap;
+    void setOptions(int index, const QVariantMap& options) const;
+    void requestOptions(int index, const QVariantMap& options, QObject* context,
+                        const std::function<void(bool success)>& callback) const;
+
+    static auto optionNames() -> QStringList;
 
     auto addDevice() const -> int;
+    void addDevices(int count) const;
     void removeDevice() const;
 
+    void requestAddDevice(QObject* context = nullptr, const Callback& callback = Callback(),
+                          Priority priority = OperationScheduler::Bulk) const;
+    void requestRemoveDevice(QObject* context = nullptr, const Callback& callback = Callback(),
+                             Priority priority = OperationScheduler::Bulk) const;
+
+    auto mountAll(const QMap<int, QString>& images) const -> int;
+
+    static auto mostAvailable(const QList<const CDEmu*>& endpoints) -> const CDEmu*;
+
+    auto scheduler() const -> const OperationScheduler&;
+
 signals:
     void daemonChanged(bool running);
 
     void deviceAdded();
     void deviceRemoved();
     void deviceChanged(int index);
+    void mappingsReady();
+    void mappingsUpdated();
 
 private slots:
     void onServiceRegistered(const QString& service);
     void onServiceUnregistered(const QString& service);
+    void onDeviceStatusChanged(int index);
+
+    void clearMappings();
+    void clearImages();
 
 private:
     void connectMethod(const QString& name, const char* slot);
@@ -76,7 +144,21 @@ private:
     static auto createMethodCall(const QString& method) -> QDBusMessage;
 
 private:
+    QString m_address;
+    QDBusConnection m_connection;
+
     QDBusServiceWatcher m_watcher;
+
+    // Everything sent to the daemon goes through here, see OperationScheduler
+    mutable OperationScheduler m_scheduler;
+
+    mutable QMap<int, Mapping> m_mappings;
+    mutable QSet<int> m_pendingMappings;
+    int m_mappingGeneration = 0;
+
+    // Devices by the identity of the file they have loaded, see ImageFile::identity()
+    mutable QHash<QString, int> m_images;
+    mutable bool m_imagesValid = false;
 };
 
 #endif // CDEMU_H
@@ -20,26 +20,64 @@
  ****************************************************************************/
 
 #include "devicelistitem.h"
+#include "eventtrace.h"
 
 #include <KLocalizedString>
 
 #include <QHBoxLayout>
+#include <QMenu>
 
 DeviceListItem::DeviceListItem(int index)
     : m_index(index),
       m_widget(new QWidget),
       m_label(new QLabel),
+      m_statusLabel(new QLabel),
+      m_activityLabel(new QLabel),
+      m_menuButton(new QToolButton),
       m_button(new QPushButton)
 {
     setFlags(Qt::NoItemFlags);
 
+    m_statusLabel->setEnabled(false);
+    m_statusLabel->hide();
+
+    m_activityLabel->setEnabled(false);
+
     m_button->setFixedWidth(30);
     m_button->setFlat(true);
 
     connect(m_button, SIGNAL(clicked()), this, SLOT(onButtonClicked()));
 
+    // Less frequently used actions
+    auto menu = new QMenu(m_widget);
+
+    m_mountToRamAction = menu->addAction(QIcon::fromTheme("media-flash"),
+                                         i18n("Mount from RAM..."));
+    connect(m_mountToRamAction, SIGNAL(triggered(bool)), this, SLOT(onMountToRamTriggered()));
+
+    m_verifyAction = menu->addAction(QIcon::fromTheme("security-high"), i18n("Verify Image"));
+    connect(m_verifyAction, SIGNAL(triggered(bool)), this, SLOT(onVerifyTriggered()));
+
+    m_benchmarkAction = menu->addAction(QIcon::fromTheme("speedometer"), i18n("Benchmark Drive"));
+    connect(m_benchmarkAction, SIGNAL(triggered(bool)), this, SLOT(onBenchmarkTriggered()));
+
+    menu->addSeparator();
+
+    QAction* optionsAction = menu->addAction(QIcon::fromTheme("configure"),
+                                             i18n("Device Options..."));
+    connect(optionsAction, SIGNAL(triggered(bool)), this, SLOT(onOptionsTriggered()));
+
+    m_menuButton->setIcon(QIcon::fromTheme("overflow-menu"));
+    m_menuButton->setToolTip(i18n("More actions"));
+    m_menuButton->setAutoRaise(true);
+    m_menuButton->setPopupMode(QToolButton::InstantPopup);
+    m_menuButton->setMenu(menu);
+
     auto layout = new QHBoxLayout(m_widget);
     layout->addWidget(m_label);
+    layout->addWidget(m_statusLabel);
+    layout->addWidget(m_activityLabel);
+    layout->addWidget(m_menuButton);
     layout->addWidget(m_button);
     layout->setContentsMargins(0, 0, 0, 0);
     m_widget->setLayout(layout);
@@ -50,6 +88,9 @@ DeviceListItem::DeviceListItem(int index)
 void DeviceListItem::setFileName(const QString& name)
 {
     m_label->setText(name);
+    m_mountToRamAction->setEnabled(name.isEmpty());
+    m_verifyAction->setEnabled(!name.isEmpty());
+    m_benchmarkAction->setEnabled(!name.isEmpty());
 
     if (name.isEmpty())
     {
@@ -66,6 +107,14 @@ void DeviceListItem::setFileName(const QString& name)
 
 // ---------------------------------------------------------------------------------------------- //
 
+void DeviceListItem::setStatusText(const QString& text)
+{
+    m_statusLabel->setText(text);
+    m_statusLabel->setVisible(!text.isEmpty());
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 auto DeviceListItem::fileName() const -> QString
 {
     return m_label->text();
@@ -73,6 +122,27 @@ auto DeviceListItem::fileName() const -> QString
 
 // ---------------------------------------------------------------------------------------------- //
 
+void DeviceListItem::setLoadedFile(const QString& filename)
+{
+    m_loadedFile = filename;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DeviceListItem::loadedFile() const -> QString
+{
+    return m_loadedFile;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DeviceListItem::setActivityText(const QString& text)
+{
+    m_activityLabel->setText(text);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 auto DeviceListItem::widget() const -> QWidget*
 {
     return m_widget;
@@ -83,9 +153,43 @@ auto DeviceListItem::widget() const -> QWidget*
 void DeviceListItem::onButtonClicked()
 {
     if (m_label->text().isEmpty())
+    {
+        EventTrace::instant("Mount clicked", m_index);
         emit mountClicked(m_index);
+    }
     else
+    {
+        EventTrace::instant("Unmount clicked", m_index);
         emit unmountClicked(m_index);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DeviceListItem::onMountToRamTriggered()
+{
+    emit mountToRamClicked(m_index);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DeviceListItem::onVerifyTriggered()
+{
+    emit verifyClicked(m_index);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DeviceListItem::onBenchmarkTriggered()
+{
+    emit benchmarkClicked(m_index);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DeviceListItem::onOptionsTriggered()
+{
+    emit optionsClicked(m_index);
 }
 
 // ---------------------------------------------------------------------------------------------- //
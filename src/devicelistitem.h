@@ -22,8 +22,10 @@
 #ifndef DEVICELISTITEM_H
 #define DEVICELISTITEM_H
 
+#include <QAction>
 #include <QLabel>
 #include <QPushButton>
+#include <QToolButton>
 #include <QTreeWidgetItem>
 
 class DeviceListItem : public QObject, public QTreeWidgetItem
@@ -36,21 +38,43 @@ public:
     void setFileName(const QString& name);
     auto fileName() const -> QString;
 
+    void setLoadedFile(const QString& filename);
+    auto loadedFile() const -> QString;
+
+    void setStatusText(const QString& text);
+    void setActivityText(const QString& text);
+
     auto widget() const -> QWidget*;
 
 signals:
     void mountClicked(int index);
     void unmountClicked(int index);
+    void mountToRamClicked(int index);
+    void verifyClicked(int index);
+    void benchmarkClicked(int index);
+    void optionsClicked(int index);
 
 private slots:
     void onButtonClicked();
+    void onMountToRamTriggered();
+    void onVerifyTriggered();
+    void onBenchmarkTriggered();
+    void onOptionsTriggered();
 
 private:
     int m_index;
+    QString m_loadedFile;
 
     QWidget* m_widget;
     QLabel* m_label;
+    QLabel* m_statusLabel;
+    QLabel* m_activityLabel;
+    QToolButton* m_menuButton;
     QPushButton* m_button;
+
+    QAction* m_mountToRamAction;
+    QAction* m_verifyAction;
+    QAction* m_benchmarkAction;
 };
 
 #endif // DEVICELISTITEM_H
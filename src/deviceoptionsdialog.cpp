@@ -0,0 +1,165 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "deviceoptionsdialog.h"
+#include "deviceprofile.h"
+#include "messagebox.h"
+
+#include <KLocalizedString>
+
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QPushButton>
+#include <QVBoxLayout>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr const char* DeviceIdOption = "device-id";
+
+    auto optionLabel(const QString& name) -> QString
+    {
+        if (name == "tr-emulation")
+            return i18n("Transfer rate emulation");
+
+        if (name == "dpm-emulation")
+            return i18n("DPM emulation");
+
+        if (name == "bad-sector-emulation")
+            return i18n("Bad sector emulation");
+
+        if (name == "dvd-report-css")
+            return i18n("Report DVD CSS encryption");
+
+        return name;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+DeviceOptionsDialog::DeviceOptionsDialog(const CDEmu& cdemu, int index, QWidget* parent)
+    : QDialog(parent),
+      m_cdemu(cdemu),
+      m_index(index),
+      m_deviceId(new QLineEdit(this))
+{
+    setWindowTitle(i18n("Options of Device %1", index));
+
+    // All options are fetched with a single batch of calls
+    try {
+        m_initialOptions = m_cdemu.getOptions(m_index);
+    }
+    catch (const Exception& e) {
+        MessageBox::error(e.what());
+    }
+
+    auto form = new QFormLayout;
+
+    for (const QString& name : CDEmu::optionNames())
+    {
+        if (name == DeviceIdOption)
+            continue;
+
+        auto checkBox = new QCheckBox(optionLabel(name), this);
+        checkBox->setChecked(m_initialOptions.value(name).toBool());
+        checkBox->setEnabled(m_initialOptions.contains(name));
+
+        form->addRow(checkBox);
+        m_checkBoxes.insert(name, checkBox);
+    }
+
+    m_deviceId->setText(m_initialOptions.value(DeviceIdOption).toString());
+    m_deviceId->setToolTip(i18n("Vendor, product, revision and vendor specific information, "
+                                "separated by commas"));
+    m_deviceId->setEnabled(m_initialOptions.contains(DeviceIdOption));
+
+    form->addRow(i18n("Device ID:"), m_deviceId);
+
+    auto buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+
+    QPushButton* defaultsButton = buttons->addButton(i18n("Save as Defaults"),
+                                                     QDialogButtonBox::ActionRole);
+
+    connect(defaultsButton, SIGNAL(clicked()), this, SLOT(saveAsDefaults()));
+    connect(buttons, SIGNAL(accepted()), this, SLOT(accept()));
+    connect(buttons, SIGNAL(rejected()), this, SLOT(reject()));
+
+    auto layout = new QVBoxLayout(this);
+    layout->addLayout(form);
+    layout->addWidget(buttons);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DeviceOptionsDialog::options() const -> QVariantMap
+{
+    QVariantMap options;
+
+    for (auto it = m_checkBoxes.cbegin(); it != m_checkBoxes.cend(); ++it)
+    {
+        if (it.value()->isEnabled())
+            options.insert(it.key(), it.value()->isChecked());
+    }
+
+    if (m_deviceId->isEnabled())
+        options.insert(DeviceIdOption, m_deviceId->text());
+
+    return options;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DeviceOptionsDialog::accept()
+{
+    // Only send what actually changed
+    QVariantMap changed;
+
+    const QVariantMap current = options();
+
+    for (auto it = current.cbegin(); it != current.cend(); ++it)
+    {
+        if (m_initialOptions.value(it.key()) != it.value())
+            changed.insert(it.key(), it.value());
+    }
+
+    try {
+        m_cdemu.setOptions(m_index, changed);
+    }
+    catch (const Exception& e) {
+        MessageBox::error(e.what());
+        return;
+    }
+
+    QDialog::accept();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DeviceOptionsDialog::saveAsDefaults()
+{
+    // The device ID is specific to a drive, so it isn't part of the defaults
+    QVariantMap defaults = options();
+    defaults.remove(DeviceIdOption);
+
+    DeviceProfile::setOptions(defaults);
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,57 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef DEVICEOPTIONSDIALOG_H
+#define DEVICEOPTIONSDIALOG_H
+
+#include "cdemu.h"
+
+#include <QCheckBox>
+#include <QDialog>
+#include <QLineEdit>
+#include <QMap>
+
+class DeviceOptionsDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    DeviceOptionsDialog(const CDEmu& cdemu, int index, QWidget* parent = nullptr);
+
+    auto options() const -> QVariantMap;
+
+public slots:
+    void accept() override;
+
+private slots:
+    void saveAsDefaults();
+
+private:
+    const CDEmu& m_cdemu;
+    int m_index;
+
+    QVariantMap m_initialOptions;
+
+    QMap<QString, QCheckBox*> m_checkBoxes;
+    QLineEdit* m_deviceId;
+};
+
+#endif // DEVICEOPTIONSDIALOG_H
@@ -0,0 +1,95 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "cdemu.h"
+#include "deviceprofile.h"
+
+#include <QSettings>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr const char* DefaultProfile = "Default";
+
+    constexpr const char* ProfilesGroup = "DeviceProfiles";
+    constexpr const char* ActiveProfileKey = "activeDeviceProfile";
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DeviceProfile::activeProfile() -> QString
+{
+    QSettings settings;
+    return settings.value(ActiveProfileKey, DefaultProfile).toString();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DeviceProfile::setActiveProfile(const QString& name)
+{
+    QSettings settings;
+    settings.setValue(ActiveProfileKey, name);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DeviceProfile::options(const QString& name) -> QVariantMap
+{
+    QSettings settings;
+    settings.beginGroup(ProfilesGroup);
+    settings.beginGroup(name);
+
+    QVariantMap options;
+
+    for (const QString& key : settings.childKeys())
+    {
+        if (CDEmu::optionNames().contains(key))
+            options.insert(key, settings.value(key));
+    }
+
+    return options;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DeviceProfile::setOptions(const QVariantMap& options, const QString& name)
+{
+    QSettings settings;
+    settings.beginGroup(ProfilesGroup);
+    settings.beginGroup(name);
+
+    settings.remove(QString());
+
+    for (auto it = options.cbegin(); it != options.cend(); ++it)
+        settings.setValue(it.key(), it.value());
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DeviceProfile::apply(const CDEmu& cdemu, int index, const QString& name)
+{
+    const QVariantMap profile = options(name);
+
+    if (!profile.isEmpty())
+        cdemu.setOptions(index, profile);
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,41 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef DEVICEPROFILE_H
+#define DEVICEPROFILE_H
+
+#include <QVariantMap>
+
+class CDEmu;
+
+class DeviceProfile
+{
+public:
+    static auto activeProfile() -> QString;
+    static void setActiveProfile(const QString& name);
+
+    static auto options(const QString& name = activeProfile()) -> QVariantMap;
+    static void setOptions(const QVariantMap& options, const QString& name = activeProfile());
+
+    static void apply(const CDEmu& cdemu, int index, const QString& name = activeProfile());
+};
+
+#endif // DEVICEPROFILE_H
@@ -0,0 +1,179 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "cdemu.h"
+#include "devicewaiter.h"
+
+#include <QFile>
+#include <QSocketNotifier>
+
+#include <fcntl.h>
+#include <linux/cdrom.h>
+#include <linux/netlink.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    // Not every kernel reports media changes of SCSI drives, so the drive is also asked directly
+    constexpr int PollInterval = 50; // ms
+
+    constexpr int UeventSize = 8192;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+DeviceWaiter::DeviceWaiter(const CDEmu& cdemu, int index, bool loaded, QObject* parent)
+    : QObject(parent),
+      m_cdemu(cdemu),
+      m_index(index),
+      m_loaded(loaded)
+{
+    connect(&m_cdemu, SIGNAL(deviceChanged(int)), this, SLOT(onDeviceChanged(int)));
+    connect(&m_cdemu, SIGNAL(mappingsReady()), this, SLOT(check()));
+
+    m_pollTimer.setInterval(PollInterval);
+    connect(&m_pollTimer, SIGNAL(timeout()), this, SLOT(check()));
+
+    m_socket = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                      NETLINK_KOBJECT_UEVENT);
+
+    sockaddr_nl address = {};
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = 1; // Kernel events, rather than the ones udev sends after processing
+
+    if (m_socket >= 0 &&
+        bind(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0)
+    {
+        m_notifier = new QSocketNotifier(m_socket, QSocketNotifier::Read, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, &DeviceWaiter::onUevent);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+DeviceWaiter::~DeviceWaiter()
+{
+    delete m_notifier;
+
+    if (m_socket >= 0)
+        close(m_socket);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DeviceWaiter::wait(int timeout) -> bool
+{
+    // The daemon has usually changed the device by the time its reply arrives
+    m_statusChanged = m_cdemu.getStatus(m_index).loaded == m_loaded;
+
+    check();
+
+    if (m_ready)
+        return true;
+
+    m_pollTimer.start();
+    QTimer::singleShot(timeout, &m_loop, &QEventLoop::quit);
+
+    m_loop.exec();
+    m_pollTimer.stop();
+
+    return m_ready;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DeviceWaiter::hasMedia(const QString& node) -> bool
+{
+    // Opening without O_NONBLOCK would fail right away while there's no disc
+    const int fd = open(QFile::encodeName(node).constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+    if (fd < 0)
+        return false;
+
+    const int status = ioctl(fd, CDROM_DRIVE_STATUS, CDSL_CURRENT);
+    close(fd);
+
+    return status == CDS_DISC_OK;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DeviceWaiter::onDeviceChanged(int index)
+{
+    if (index != m_index)
+        return;
+
+    m_statusChanged = m_cdemu.getStatus(m_index).loaded == m_loaded;
+    check();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DeviceWaiter::onUevent()
+{
+    char buffer[UeventSize];
+    bool relevant = false;
+
+    // E.g. "change@/devices/.../block/sr0", followed by the environment
+    const QByteArray node = QFile::encodeName(m_node.mid(m_node.lastIndexOf('/')));
+
+    for (;;)
+    {
+        const ssize_t length = recv(m_socket, buffer, sizeof(buffer) - 1, 0);
+
+        if (length <= 0)
+            break;
+
+        buffer[length] = '\0';
+
+        if (!m_node.isEmpty() && QByteArray(buffer).endsWith(node))
+            relevant = true;
+    }
+
+    if (relevant)
+        check();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DeviceWaiter::check()
+{
+    if (m_ready || !m_statusChanged)
+        return;
+
+    // Empty until the kernel has created the device node
+    if (m_node.isEmpty())
+        m_node = m_cdemu.getMapping(m_index).scsiCdRom;
+
+    if (m_node.isEmpty())
+        return;
+
+    if (hasMedia(m_node) == m_loaded)
+    {
+        m_ready = true;
+        m_loop.quit();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
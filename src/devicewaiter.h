@@ -0,0 +1,68 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef DEVICEWAITER_H
+#define DEVICEWAITER_H
+
+#include <QEventLoop>
+#include <QObject>
+#include <QTimer>
+
+class CDEmu;
+class QSocketNotifier;
+
+class DeviceWaiter : public QObject
+{
+    Q_OBJECT
+
+public:
+    DeviceWaiter(const CDEmu& cdemu, int index, bool loaded, QObject* parent = nullptr);
+    ~DeviceWaiter() override;
+
+    auto wait(int timeout) -> bool;
+
+    static auto hasMedia(const QString& node) -> bool;
+
+private slots:
+    void onDeviceChanged(int index);
+    void onUevent();
+
+    void check();
+
+private:
+    const CDEmu& m_cdemu;
+    const int m_index;
+    const bool m_loaded;
+
+    bool m_statusChanged = false;
+    bool m_ready = false;
+
+    QString m_node;
+
+    // Kernel uevents, which report media changes if the kernel polls the drive
+    int m_socket = -1;
+    QSocketNotifier* m_notifier = nullptr;
+
+    QTimer m_pollTimer;
+    QEventLoop m_loop;
+};
+
+#endif // DEVICEWAITER_H
@@ -0,0 +1,222 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "cdemu.h"
+#include "discset.h"
+#include "mountjournal.h"
+
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QUrl>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr const char* DiscSetsGroup = "DiscSets";
+
+    constexpr const char* ImagesKey  = "images";
+    constexpr const char* AddressKey = "address";
+    constexpr const char* DeviceKey  = "device";
+    constexpr const char* CurrentKey = "current";
+
+    // QSettings takes slashes as separators of nested groups
+    auto groupKey(const QString& name) -> QString
+    {
+        QString key = name;
+        return key.replace('%', "%25").replace('/', "%2F").replace('\\', "%5C");
+    }
+
+    auto groupName(const QString& key) -> QString
+    {
+        return QUrl::fromPercentEncoding(key.toUtf8());
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+DiscSet::DiscSet(const QString& name, const QStringList& images)
+    : m_name(name),
+      m_images(images) {}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DiscSet::isValid() const -> bool
+{
+    return !m_name.isEmpty() && !m_images.isEmpty();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DiscSet::name() const -> QString
+{
+    return m_name;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DiscSet::images() const -> QStringList
+{
+    return m_images;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DiscSet::current() const -> int
+{
+    return m_current;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DiscSet::device() const -> int
+{
+    return m_device;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DiscSet::address() const -> QString
+{
+    return m_address;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DiscSet::endpoint(const QList<const CDEmu*>& endpoints) const -> const CDEmu&
+{
+    if (m_device < 0)
+        throw Exception(Error::DeviceNotAvailable);
+
+    for (const CDEmu* cdemu : endpoints)
+    {
+        if (cdemu->address() == m_address)
+            return *cdemu;
+    }
+
+    throw Exception(Error::DaemonNotRunning);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DiscSet::insert(const CDEmu& cdemu, int index, int disc) -> qint64
+{
+    Q_ASSERT(disc >= 0 && disc < m_images.size());
+
+    // The guest sees no media for as long as this takes
+    QElapsedTimer timer;
+    timer.start();
+
+    cdemu.swap(index, m_images.at(disc));
+
+    const qint64 gap = timer.elapsed();
+
+    setInserted(cdemu, index, disc);
+
+    return gap;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DiscSet::setInserted(const CDEmu& cdemu, int index, int disc)
+{
+    Q_ASSERT(disc >= 0 && disc < m_images.size());
+
+    // For discs swapped in without waiting, see CDEmu::requestSwap()
+    m_address = cdemu.address();
+    m_device = index;
+    m_current = disc;
+
+    save();
+
+    if (m_address.isEmpty())
+        MountJournal::recordMount(index, m_images.at(disc));
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DiscSet::next(const QList<const CDEmu*>& endpoints) -> qint64
+{
+    // Starts over after the last disc
+    return insert(endpoint(endpoints), m_device, (m_current + 1) % m_images.size());
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DiscSet::save() const
+{
+    QSettings settings;
+    settings.beginGroup(DiscSetsGroup);
+    settings.beginGroup(groupKey(m_name));
+
+    settings.setValue(ImagesKey, m_images);
+    settings.setValue(AddressKey, m_address);
+    settings.setValue(DeviceKey, m_device);
+    settings.setValue(CurrentKey, m_current);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DiscSet::load(const QString& name) -> DiscSet
+{
+    QSettings settings;
+    settings.beginGroup(DiscSetsGroup);
+
+    if (!settings.childGroups().contains(groupKey(name)))
+        throw Exception(Error::DiscSetNotFound);
+
+    settings.beginGroup(groupKey(name));
+
+    DiscSet set(name, settings.value(ImagesKey).toStringList());
+    set.m_address = settings.value(AddressKey).toString();
+    set.m_device = settings.value(DeviceKey, -1).toInt();
+    set.m_current = qBound(0, settings.value(CurrentKey).toInt(), qMax(0, set.m_images.size() - 1));
+
+    if (!set.isValid())
+        throw Exception(Error::DiscSetNotFound);
+
+    return set;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DiscSet::names() -> QStringList
+{
+    QSettings settings;
+    settings.beginGroup(DiscSetsGroup);
+
+    QStringList names;
+
+    for (const QString& key : settings.childGroups())
+        names << groupName(key);
+
+    return names;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DiscSet::remove(const QString& name)
+{
+    QSettings settings;
+    settings.beginGroup(DiscSetsGroup);
+    settings.remove(groupKey(name));
+}
+
+// ---------------------------------------------------------------------------------------------- //
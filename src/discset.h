@@ -0,0 +1,67 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef DISCSET_H
+#define DISCSET_H
+
+#include <QList>
+#include <QStringList>
+
+class CDEmu;
+
+class DiscSet
+{
+public:
+    DiscSet(const QString& name = QString(), const QStringList& images = QStringList());
+
+    auto isValid() const -> bool;
+
+    auto name() const -> QString;
+    auto images() const -> QStringList;
+
+    auto current() const -> int;
+    auto device() const -> int;
+    auto address() const -> QString;
+
+    auto endpoint(const QList<const CDEmu*>& endpoints) const -> const CDEmu&;
+
+    auto insert(const CDEmu& cdemu, int index, int disc) -> qint64;
+    auto next(const QList<const CDEmu*>& endpoints) -> qint64;
+    void setInserted(const CDEmu& cdemu, int index, int disc);
+
+    void save() const;
+
+    static auto load(const QString& name) -> DiscSet;
+    static auto names() -> QStringList;
+    static void remove(const QString& name);
+
+private:
+    QString m_name;
+    QStringList m_images;
+
+    // The drive the set is bound to
+    QString m_address;
+    int m_device = -1;
+
+    int m_current = 0;
+};
+
+#endif // DISCSET_H
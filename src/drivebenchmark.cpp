@@ -0,0 +1,258 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "drivebenchmark.h"
+#include "exception.h"
+
+#include <QFile>
+#include <QThread>
+
+#include <algorithm>
+#include <cerrno>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <random>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr int Alignment = 4096;
+
+    constexpr int DefaultBlockSize = 64 * 1024;
+    constexpr int DefaultQueueDepth = 4;
+    constexpr int DefaultDuration = 5000; // ms
+
+    using Clock = std::chrono::steady_clock;
+
+    auto percentile(const std::vector<qint64>& sorted, double fraction) -> double
+    {
+        if (sorted.empty())
+            return 0.0;
+
+        const size_t index = qMin(sorted.size() - 1, size_t(fraction * sorted.size()));
+        return sorted.at(index) / 1e6;
+    }
+
+    auto throughput(const DriveBenchmark::Result& result) -> double
+    {
+        return result.seconds > 0.0 ? result.bytes / result.seconds : 0.0;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+DriveBenchmark::DriveBenchmark(QObject* parent)
+    : QObject(parent) {}
+
+// ---------------------------------------------------------------------------------------------- //
+
+DriveBenchmark::~DriveBenchmark()
+{
+    if (m_thread)
+    {
+        m_thread->wait();
+        delete m_thread;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DriveBenchmark::start(const QStringList& targets, const Parameters& parameters)
+{
+    Q_ASSERT(!isRunning());
+
+    delete m_thread;
+
+    m_thread = QThread::create([this, targets, parameters] {
+        emit finished(run(targets, parameters));
+    });
+
+    m_thread->start();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DriveBenchmark::isRunning() const -> bool
+{
+    return m_thread && m_thread->isRunning();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DriveBenchmark::defaultParameters() -> Parameters
+{
+    return { DefaultBlockSize, DefaultQueueDepth, DefaultDuration };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DriveBenchmark::run(const QStringList& targets, const Parameters& parameters) -> QString
+{
+    QStringList report;
+    QList<Result> results;
+
+    for (const QString& target : targets)
+    {
+        for (bool random : { false, true })
+        {
+            try {
+                results << run(target, random, parameters);
+                report << format(results.last());
+            }
+            catch (const Exception& e) {
+                report << QString("%1: %2").arg(target, QString::fromLocal8Bit(e.what()));
+                break;
+            }
+        }
+    }
+
+    // The first target is the emulated drive, the second one the image file behind it
+    if (results.size() == 4)
+    {
+        const double sequential = throughput(results.at(0)) / throughput(results.at(2));
+        const double random = throughput(results.at(1)) / throughput(results.at(3));
+
+        report << QString("Emulation overhead: sequential %1%, random %2%")
+                  .arg(100.0 * (1.0 - sequential), 0, 'f', 1)
+                  .arg(100.0 * (1.0 - random), 0, 'f', 1);
+    }
+
+    return report.join('\n');
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DriveBenchmark::run(const QString& target, bool random, const Parameters& parameters) -> Result
+{
+    const QByteArray path = QFile::encodeName(target);
+
+    // Bypass the page cache where the file system allows it
+    bool direct = true;
+    int fd = open(path.constData(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+
+    if (fd < 0 && errno == EINVAL)
+    {
+        direct = false;
+        fd = open(path.constData(), O_RDONLY | O_CLOEXEC);
+    }
+
+    if (fd < 0)
+        throw Exception(Error::FileNotReadable);
+
+    quint64 size = 0;
+
+    if (ioctl(fd, BLKGETSIZE64, &size) != 0)
+        size = quint64(qMax<off_t>(0, lseek(fd, 0, SEEK_END)));
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    const qint64 blockSize = qMax(1, parameters.blockSize / Alignment) * Alignment;
+    const qint64 blocks = qint64(size) / blockSize;
+    const int queueDepth = qMax(1, parameters.queueDepth);
+
+    if (blocks <= 0)
+    {
+        close(fd);
+        throw Exception(Error::FileNotReadable);
+    }
+
+    // Synchronous reads from one thread per queue slot keep that many requests in flight
+    std::atomic<qint64> next(0);
+    std::vector<std::vector<qint64>> latencies(queueDepth);
+    std::vector<std::future<void>> workers;
+
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point deadline = start + std::chrono::milliseconds(parameters.duration);
+
+    for (int worker = 0; worker < queueDepth; ++worker)
+    {
+        workers.push_back(std::async(std::launch::async, [&, worker] {
+            void* buffer = nullptr;
+
+            if (posix_memalign(&buffer, Alignment, blockSize) != 0)
+                return;
+
+            std::mt19937_64 generator(worker + 1);
+            std::uniform_int_distribution<qint64> distribution(0, blocks - 1);
+
+            while (Clock::now() < deadline)
+            {
+                const qint64 block = random ? distribution(generator) : next++ % blocks;
+                const Clock::time_point before = Clock::now();
+
+                if (pread(fd, buffer, blockSize, block * blockSize) != blockSize)
+                    break;
+
+                const auto latency = Clock::now() - before;
+                latencies[worker].push_back(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+            }
+
+            free(buffer);
+        }));
+    }
+
+    for (auto& worker : workers)
+        worker.get();
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    close(fd);
+
+    std::vector<qint64> sorted;
+
+    for (const auto& workerLatencies : latencies)
+        sorted.insert(sorted.end(), workerLatencies.begin(), workerLatencies.end());
+
+    std::sort(sorted.begin(), sorted.end());
+
+    const qint64 operations = qint64(sorted.size());
+
+    return { target, random, direct, operations, operations * blockSize, seconds,
+             { percentile(sorted, 0.5), percentile(sorted, 0.9),
+               percentile(sorted, 0.99), percentile(sorted, 1.0) } };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DriveBenchmark::format(const Result& result) -> QString
+{
+    const double iops = result.seconds > 0.0 ? result.operations / result.seconds : 0.0;
+
+    return QString("%1 %2: %3 MB/s, %4 IOPS, latency p50 %5 ms, p90 %6 ms, p99 %7 ms, max %8 ms%9")
+            .arg(QString(result.random ? "Random" : "Sequential"), result.target)
+            .arg(throughput(result) / 1e6, 0, 'f', 1)
+            .arg(qRound(iops))
+            .arg(result.latencies[0], 0, 'f', 2)
+            .arg(result.latencies[1], 0, 'f', 2)
+            .arg(result.latencies[2], 0, 'f', 2)
+            .arg(result.latencies[3], 0, 'f', 2)
+            .arg(QString(result.direct ? "" : " (cached)"));
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,73 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef DRIVEBENCHMARK_H
+#define DRIVEBENCHMARK_H
+
+#include <QObject>
+#include <QStringList>
+
+class QThread;
+
+class DriveBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Parameters
+    {
+        int blockSize;
+        int queueDepth;
+        int duration; // ms
+    };
+
+    struct Result
+    {
+        QString target;
+        bool random;
+        bool direct;
+        qint64 operations;
+        qint64 bytes;
+        double seconds;
+        double latencies[4]; // p50, p90, p99 and max in ms
+    };
+
+public:
+    DriveBenchmark(QObject* parent = nullptr);
+    ~DriveBenchmark() override;
+
+    void start(const QStringList& targets, const Parameters& parameters = defaultParameters());
+    auto isRunning() const -> bool;
+
+    static auto defaultParameters() -> Parameters;
+
+    static auto run(const QStringList& targets, const Parameters& parameters) -> QString;
+    static auto run(const QString& target, bool random, const Parameters& parameters) -> Result;
+    static auto format(const Result& result) -> QString;
+
+signals:
+    void finished(const QString& report);
+
+private:
+    QThread* m_thread = nullptr;
+};
+
+#endif // DRIVEBENCHMARK_H
@@ -0,0 +1,246 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "eventtrace.h"
+
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QSocketNotifier>
+#include <QStandardPaths>
+
+#include <atomic>
+#include <chrono>
+
+#include <csignal>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr quint64 Capacity = 4096;
+
+    constexpr int DumpSignal = SIGUSR1;
+
+    struct Record
+    {
+        qint64 time; // ns
+        qint64 thread;
+        int device;
+        quint32 id;
+        char phase;
+        char name[39];
+    };
+
+    struct Slot
+    {
+        // Odd while being written, 2 * ticket + 2 once complete
+        std::atomic<quint64> sequence;
+        Record record;
+    };
+
+    Slot Slots[Capacity];
+    std::atomic<quint64> Head(0);
+
+    int SignalPipe[2] = { -1, -1 };
+
+    void onDumpSignal(int)
+    {
+        // Only async-signal-safe calls are allowed in here
+        const char byte = 0;
+        const ssize_t written = write(SignalPipe[1], &byte, 1);
+        Q_UNUSED(written)
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void EventTrace::instant(const char* name, int device)
+{
+    record('i', name, device);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void EventTrace::begin(const char* name, int device)
+{
+    record('B', name, device);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void EventTrace::end(const char* name, int device)
+{
+    record('E', name, device);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void EventTrace::beginAsync(const char* name, quint32 id, int device)
+{
+    record('b', name, device, id);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void EventTrace::endAsync(const char* name, quint32 id, int device)
+{
+    record('e', name, device, id);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto EventTrace::dump(const QString& filename) -> bool
+{
+    const quint64 head = Head.load(std::memory_order_acquire);
+    const quint64 first = head > Capacity ? head - Capacity : 0;
+
+    const qint64 pid = getpid();
+
+    QJsonArray events;
+    qint64 start = -1;
+
+    for (quint64 ticket = first; ticket < head; ++ticket)
+    {
+        const Slot& slot = Slots[ticket % Capacity];
+        const quint64 sequence = slot.sequence.load(std::memory_order_acquire);
+
+        // Still being written or already overwritten
+        if (sequence != 2 * ticket + 2)
+            continue;
+
+        const Record record = slot.record;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+            continue;
+
+        if (start < 0)
+            start = record.time;
+
+        QJsonObject event = {
+            { "name", QString::fromLatin1(record.name) },
+            { "ph", QString(QChar::fromLatin1(record.phase)) },
+            { "ts", double(record.time - start) / 1000.0 },
+            { "pid", pid },
+            { "tid", record.thread }
+        };
+
+        if (record.phase == 'i')
+            event.insert("s", "t");
+
+        if (record.phase == 'b' || record.phase == 'e')
+        {
+            event.insert("cat", "async");
+            event.insert("id", QString::number(record.id));
+        }
+
+        if (record.device >= 0)
+            event.insert("args", QJsonObject({ { "device", record.device } }));
+
+        events.append(event);
+    }
+
+    const QJsonObject trace = {
+        { "traceEvents", events },
+        { "displayTimeUnit", "ms" }
+    };
+
+    QSaveFile file(filename);
+
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+
+    return file.commit();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto EventTrace::dumpPath() -> QString
+{
+    return QStandardPaths::writableLocation(QStandardPaths::TempLocation) + "/kde_cdemu-trace.json";
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void EventTrace::installSignalHandler()
+{
+    if (SignalPipe[0] >= 0 || pipe2(SignalPipe, O_CLOEXEC | O_NONBLOCK) != 0)
+        return;
+
+    // The handler only wakes up the event loop, which then writes the file
+    auto notifier = new QSocketNotifier(SignalPipe[0], QSocketNotifier::Read, qApp);
+
+    QObject::connect(notifier, &QSocketNotifier::activated, notifier, [] {
+        char byte = 0;
+
+        while (read(SignalPipe[0], &byte, 1) > 0)
+            continue;
+
+        dump(dumpPath());
+    });
+
+    struct sigaction action = {};
+    action.sa_handler = onDumpSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    sigaction(DumpSignal, &action, nullptr);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto EventTrace::requestDump(qint64 pid) -> bool
+{
+    return pid > 0 && kill(pid_t(pid), DumpSignal) == 0;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void EventTrace::record(char phase, const char* name, int device, quint32 id)
+{
+    using namespace std::chrono;
+
+    const quint64 ticket = Head.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = Slots[ticket % Capacity];
+
+    slot.sequence.store(2 * ticket + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Record& record = slot.record;
+    record.time = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    record.thread = syscall(SYS_gettid);
+    record.device = device;
+    record.id = id;
+    record.phase = phase;
+    qstrncpy(record.name, name, sizeof(record.name));
+
+    slot.sequence.store(2 * ticket + 2, std::memory_order_release);
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,48 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef EVENTTRACE_H
+#define EVENTTRACE_H
+
+#include <QString>
+
+class EventTrace
+{
+public:
+    static void instant(const char* name, int device = -1);
+    static void begin(const char* name, int device = -1);
+    static void end(const char* name, int device = -1);
+
+    // Spans that overlap others on the same thread, matched by their id
+    static void beginAsync(const char* name, quint32 id, int device = -1);
+    static void endAsync(const char* name, quint32 id, int device = -1);
+
+    static auto dump(const QString& filename) -> bool;
+    static auto dumpPath() -> QString;
+
+    static void installSignalHandler();
+    static auto requestDump(qint64 pid) -> bool;
+
+private:
+    static void record(char phase, const char* name, int device, quint32 id = 0);
+};
+
+#endif // EVENTTRACE_H
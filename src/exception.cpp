@@ -41,9 +41,69 @@ static auto getErrorString(Error error) -> QString
     case Error::FileNotFound:
         return i18n("The file doesn't exist.");
 
+    case Error::FileNotReadable:
+        return i18n("The file couldn't be read.");
+
+    case Error::FolderNotWatchable:
+        return i18n("The folder couldn't be watched.");
+
+    case Error::ChecksumMismatch:
+        return i18n("The image doesn't match its checksum file.");
+
+    case Error::ImageNotVerified:
+        return i18n("The image couldn't be verified against a checksum file.");
+
+    case Error::DecompressionFailed:
+        return i18n("The image couldn't be decompressed.");
+
+    case Error::StagingFailed:
+        return i18n("The image couldn't be copied into memory.");
+
+    case Error::InsufficientMemory:
+        return i18n("There isn't enough memory available to hold the image.");
+
+    case Error::InvalidOption:
+        return i18n("The device option is invalid.");
+
+    case Error::InvalidCommand:
+        return i18n("The command is invalid.");
+
     case Error::DaemonNotRunning:
         return i18n("Unable to connect to the CDEmu daemon.");
 
+    case Error::DaemonNotAvailable:
+        return i18n("There is no daemon with the selected number.");
+
+    case Error::DaemonNotResponding:
+        return i18n("The CDEmu daemon is not responding.");
+
+    case Error::InstanceNotRunning:
+        return i18n("KDE CDEmu Manager isn't running.");
+
+    case Error::DiscSetNotFound:
+        return i18n("The disc set doesn't exist.");
+
+    case Error::WaitTimedOut:
+        return i18n("The device didn't become ready in time.");
+
+    case Error::RecordingFailed:
+        return i18n("The daemon traffic couldn't be recorded.");
+
+    case Error::ReplayFailed:
+        return i18n("The recorded daemon traffic couldn't be replayed.");
+
+    case Error::ExtractionFailed:
+        return i18n("The image couldn't be extracted from the archive.");
+
+    case Error::ScratchSpaceExhausted:
+        return i18n("There isn't enough scratch space to extract the image.");
+
+    case Error::ImageNotInArchive:
+        return i18n("The archive doesn't contain this image.");
+
+    case Error::AmbiguousArchive:
+        return i18n("The archive contains several images, choose one with archive:image.");
+
     default:
         return i18n("An unknown error occured.");
     }
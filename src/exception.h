@@ -30,7 +30,27 @@ enum class Error
     DeviceNotAvailable,
     NoFreeDevice,
     FileNotFound,
+    FileNotReadable,
+    FolderNotWatchable,
+    ChecksumMismatch,
+    ImageNotVerified,
+    DecompressionFailed,
+    StagingFailed,
+    InsufficientMemory,
+    InvalidOption,
+    InvalidCommand,
     DaemonNotRunning,
+    DaemonNotAvailable,
+    DaemonNotResponding,
+    InstanceNotRunning,
+    DiscSetNotFound,
+    WaitTimedOut,
+    RecordingFailed,
+    ReplayFailed,
+    ExtractionFailed,
+    ScratchSpaceExhausted,
+    ImageNotInArchive,
+    AmbiguousArchive,
     UnknownError
 };
 
@@ -0,0 +1,431 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "hotset.h"
+#include "imagefile.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QThread>
+
+#include <mutex>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr const char* HotSetsKey = "learnHotSets";
+
+    // One bit per MiB keeps the bitmap of a DVD image below a kilobyte
+    constexpr qint64 ExtentSize = 1024 * 1024;
+
+    constexpr quint32 FileMagic = 0x48534554; // "HSET"
+
+    // How long the prefetch worker waits for its read-ahead to land
+    constexpr int SettlePolls = 50;
+    constexpr int SettleInterval = 100;
+
+    // Extents the daemon was seen reading during the current mount
+    QHash<QString, QBitArray> SessionExtents;
+
+    // Extents prefetched at mount time
+    QHash<QString, QBitArray> PrefetchedExtents;
+
+    // Extents resident for other reasons, like a prefetch, warm-up or verification
+    QHash<QString, QBitArray> BaselineExtents;
+
+    // Files currently read by something other than the daemon, see HotSet::Reader
+    QHash<QString, int> Readers;
+
+    // Sampling and the workers all run on threads of their own
+    std::mutex Mutex;
+
+    void merge(QBitArray& extents, const QBitArray& other)
+    {
+        if (extents.size() == other.size())
+            extents |= other;
+        else
+            extents = other;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+HotSet::HotSet(QObject* parent)
+    : QObject(parent) {}
+
+// ---------------------------------------------------------------------------------------------- //
+
+HotSet::~HotSet()
+{
+    if (m_thread)
+    {
+        m_thread->wait();
+        delete m_thread;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void HotSet::start(const QString& filename)
+{
+    Q_ASSERT(!isRunning());
+
+    delete m_thread;
+
+    m_thread = QThread::create([this, filename] {
+        const Reader reader(filename);
+        const qint64 bytes = prefetch(filename);
+
+        if (bytes > 0)
+            settle(filename);
+
+        emit finished(filename, bytes);
+    });
+
+    m_thread->start(QThread::LowPriority);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto HotSet::isRunning() const -> bool
+{
+    return m_thread && m_thread->isRunning();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+HotSet::Reader::Reader(const QString& filename)
+    : m_dataFile(ImageFile::dataFile(filename))
+{
+    std::lock_guard<std::mutex> lock(Mutex);
+    ++Readers[m_dataFile];
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+HotSet::Reader::~Reader()
+{
+    // What was read stays cached for a while and mustn't be taken for the daemon's doing
+    const QBitArray resident = isEnabled() ? sample(m_dataFile) : QBitArray();
+
+    std::lock_guard<std::mutex> lock(Mutex);
+
+    if (--Readers[m_dataFile] == 0)
+        Readers.remove(m_dataFile);
+
+    if (!resident.isEmpty())
+        merge(BaselineExtents[m_dataFile], resident);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto HotSet::isEnabled() -> bool
+{
+    QSettings settings;
+    return settings.value(HotSetsKey, false).toBool();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void HotSet::setEnabled(bool enabled)
+{
+    QSettings settings;
+    settings.setValue(HotSetsKey, enabled);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto HotSet::sample(const QString& filename) -> QBitArray
+{
+    // Pages read by the daemon are in the shared page cache, so mapping the file shows them
+    const int fd = open(QFile::encodeName(filename).constData(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return QBitArray();
+
+    struct stat info = {};
+
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        return QBitArray();
+    }
+
+    const qint64 size = info.st_size;
+    void* data = mmap(nullptr, size_t(size), PROT_READ, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return QBitArray();
+
+    const qint64 pageSize = sysconf(_SC_PAGESIZE);
+    const qint64 pagesPerExtent = ExtentSize / pageSize;
+
+    std::vector<unsigned char> pages(size_t((size + pageSize - 1) / pageSize));
+    QBitArray extents;
+
+    if (mincore(data, size_t(size), pages.data()) == 0)
+    {
+        extents.resize(int((size + ExtentSize - 1) / ExtentSize));
+
+        for (size_t i = 0; i < pages.size(); ++i)
+        {
+            if (pages[i] & 1)
+                extents.setBit(int(qint64(i) / pagesPerExtent));
+        }
+    }
+
+    munmap(data, size_t(size));
+
+    return extents;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto HotSet::prefetch(const QString& filename) -> qint64
+{
+    const QString dataFile = ImageFile::dataFile(filename);
+    const QBitArray extents = load(dataFile);
+
+    if (extents.isEmpty())
+        return 0;
+
+    // Only what isn't cached already has to come from the storage
+    const QBitArray resident = sample(dataFile);
+    const QBitArray missing = resident.size() == extents.size() ? extents & ~resident : extents;
+
+    const int fd = open(QFile::encodeName(dataFile).constData(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return 0;
+
+    qint64 bytes = 0;
+
+    for (int i = 0; i < missing.size(); ++i)
+    {
+        if (!missing.testBit(i))
+            continue;
+
+        // Adjacent extents are requested at once
+        int end = i + 1;
+
+        while (end < missing.size() && missing.testBit(end))
+            ++end;
+
+        const qint64 offset = qint64(i) * ExtentSize;
+        const qint64 length = qint64(end - i) * ExtentSize;
+
+        if (posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED) == 0)
+            bytes += length;
+
+        i = end;
+    }
+
+    close(fd);
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    PrefetchedExtents.insert(dataFile, extents);
+
+    // The read-ahead may still be in flight when the reader takes its sample
+    merge(BaselineExtents[dataFile], extents);
+
+    return bytes;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void HotSet::settle(const QString& filename)
+{
+    const QString dataFile = ImageFile::dataFile(filename);
+
+    QBitArray prefetched;
+
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        prefetched = PrefetchedExtents.value(dataFile);
+    }
+
+    // Read-ahead arriving after the reader is gone would look like the daemon's doing
+    for (int i = 0; i < SettlePolls; ++i)
+    {
+        const QBitArray resident = sample(dataFile);
+
+        if (resident.size() != prefetched.size() || (prefetched & ~resident).count(true) == 0)
+            return;
+
+        QThread::msleep(SettleInterval);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto HotSet::learn(const QString& filename) -> Statistics
+{
+    const QString dataFile = ImageFile::dataFile(filename);
+    const QBitArray resident = sample(dataFile);
+
+    if (resident.isEmpty())
+        return { 0, 0, 0 };
+
+    QBitArray hotSet;
+    QBitArray prefetched;
+    QBitArray unknown;
+
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+
+        // Whatever a verification, warm-up or prefetch pulls in says nothing about the daemon
+        if (Readers.contains(dataFile))
+            return { 0, 0, 0 };
+
+        // Once evicted, an extent only comes back if the daemon reads it
+        QBitArray& baseline = BaselineExtents[dataFile];
+
+        if (baseline.size() != resident.size())
+            baseline = QBitArray(resident.size());
+
+        baseline &= resident;
+
+        // Pages may be evicted while mounted, so everything seen during the mount is kept
+        QBitArray& extents = SessionExtents[dataFile];
+
+        if (extents.size() != resident.size())
+            extents = QBitArray(resident.size());
+
+        extents |= resident & ~baseline;
+
+        hotSet = extents;
+        prefetched = PrefetchedExtents.value(dataFile);
+
+        // A prefetched extent that never left the cache may or may not have been read
+        if (prefetched.size() == baseline.size())
+            unknown = prefetched & baseline;
+    }
+
+    // Only what the daemon was seen reading is kept, so unused extents age out
+    save(dataFile, hotSet);
+
+    // How much of what was used had been predicted, an unknown extent isn't counted as a hit
+    const int used = hotSet.count(true);
+    const int hits = prefetched.size() == hotSet.size() ? (hotSet & prefetched).count(true) : 0;
+
+    return { used * ExtentSize, used > 0 ? hits * 100 / used : 0,
+             unknown.count(true) * ExtentSize };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void HotSet::forget(const QStringList& loadedFiles)
+{
+    QStringList dataFiles;
+
+    for (const QString& filename : loadedFiles)
+        dataFiles << ImageFile::dataFile(filename);
+
+    std::lock_guard<std::mutex> lock(Mutex);
+
+    // The next mount starts a new session
+    for (QHash<QString, QBitArray>* hash : { &SessionExtents, &PrefetchedExtents,
+                                             &BaselineExtents })
+    {
+        for (auto it = hash->begin(); it != hash->end();)
+        {
+            if (dataFiles.contains(it.key()))
+                ++it;
+            else
+                it = hash->erase(it);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto HotSet::load(const QString& filename) -> QBitArray
+{
+    QFile file(path(filename));
+
+    if (!file.open(QIODevice::ReadOnly))
+        return QBitArray();
+
+    QDataStream stream(&file);
+
+    quint32 magic = 0;
+    QString identity;
+    QBitArray extents;
+
+    stream >> magic >> identity >> extents;
+
+    // A modified image starts over
+    if (stream.status() != QDataStream::Ok || magic != FileMagic ||
+        identity != ImageFile::identity(filename))
+    {
+        return QBitArray();
+    }
+
+    return extents;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto HotSet::save(const QString& filename, const QBitArray& extents) -> bool
+{
+    const QString target = path(filename);
+
+    if (!QDir().mkpath(QFileInfo(target).path()))
+        return false;
+
+    QSaveFile file(target);
+
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream << FileMagic << ImageFile::identity(filename) << extents;
+
+    return file.commit();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto HotSet::path(const QString& filename) -> QString
+{
+    const QByteArray hash = QCryptographicHash::hash(QFile::encodeName(filename),
+                                                     QCryptographicHash::Sha1).toHex();
+
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/hotsets/" +
+           QString::fromLatin1(hash);
+}
+
+// ---------------------------------------------------------------------------------------------- //
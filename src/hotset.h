@@ -0,0 +1,88 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef HOTSET_H
+#define HOTSET_H
+
+#include <QBitArray>
+#include <QObject>
+#include <QStringList>
+
+class QThread;
+
+class HotSet : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Statistics
+    {
+        qint64 size;
+        int hitRate;
+        qint64 unknown;
+    };
+
+    // Marks a file as being read by something other than the daemon while it exists
+    class Reader
+    {
+    public:
+        explicit Reader(const QString& filename);
+        ~Reader();
+
+        Reader(const Reader&) = delete;
+        auto operator=(const Reader&) -> Reader& = delete;
+
+    private:
+        const QString m_dataFile;
+    };
+
+public:
+    HotSet(QObject* parent = nullptr);
+    ~HotSet() override;
+
+    void start(const QString& filename);
+    auto isRunning() const -> bool;
+
+    static auto isEnabled() -> bool;
+    static void setEnabled(bool enabled);
+
+    static auto sample(const QString& filename) -> QBitArray;
+    static auto prefetch(const QString& filename) -> qint64;
+
+    static auto learn(const QString& filename) -> Statistics;
+    static void forget(const QStringList& loadedFiles);
+
+signals:
+    void finished(const QString& filename, qint64 bytes);
+
+private:
+    static void settle(const QString& filename);
+
+    static auto load(const QString& filename) -> QBitArray;
+    static auto save(const QString& filename, const QBitArray& extents) -> bool;
+
+    static auto path(const QString& filename) -> QString;
+
+private:
+    QThread* m_thread = nullptr;
+};
+
+#endif // HOTSET_H
@@ -0,0 +1,409 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "exception.h"
+#include "imagecache.h"
+#include "imagefile.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QProcess>
+#include <QSet>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTemporaryFile>
+#include <QThread>
+
+#include <algorithm>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr int DefaultSizeLimit = 8192; // MiB
+    constexpr int PollInterval = 100; // ms
+
+    constexpr const char* UseImageCacheKey = "useImageCache";
+    constexpr const char* ImageCacheSizeKey = "imageCacheSize";
+
+    constexpr const char* SourcesGroup = "sources";
+    constexpr const char* ImagesGroup = "images";
+
+    constexpr const char* FileKey = "file";
+    constexpr const char* SizeKey = "size";
+    constexpr const char* SourceKey = "source";
+    constexpr const char* LastUsedKey = "lastUsed";
+
+    auto innerSuffix(const QString& filename) -> QString
+    {
+        // E.g. "iso" for "image.iso.xz"
+        return QFileInfo(QFileInfo(filename).completeBaseName()).suffix().toLower();
+    }
+
+    auto decompressor(const QString& suffix) -> QStringList
+    {
+        // xz only uses several threads for streams written in multiple blocks, e.g. by xz -T0.
+        // Inflating gzip is sequential, pigz merely reads, writes and checks on other threads.
+        if (suffix == "xz")
+            return { "xz", "--decompress", "--stdout", "--threads=0" };
+
+        if (!QStandardPaths::findExecutable("pigz").isEmpty())
+            return { "pigz", "--decompress", "--stdout" };
+
+        return { "gzip", "--decompress", "--stdout" };
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+ImageCache::ImageCache(QObject* parent)
+    : QObject(parent),
+      m_stopping(false) {}
+
+// ---------------------------------------------------------------------------------------------- //
+
+ImageCache::~ImageCache()
+{
+    if (m_thread)
+    {
+        // Kills the decompressor instead of waiting for it
+        m_stopping = true;
+        m_thread->wait();
+        delete m_thread;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ImageCache::start(const QString& filename)
+{
+    Q_ASSERT(!isRunning());
+
+    delete m_thread;
+
+    m_thread = QThread::create([this, filename] {
+        bool success = false;
+
+        try {
+            expand(filename, &m_stopping);
+            success = true;
+        }
+        catch (const Exception& e) {
+            qDebug() << "Unable to cache image:" << e.what();
+        }
+
+        if (!m_stopping)
+            emit finished(filename, success);
+    });
+
+    m_thread->start(QThread::LowPriority);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageCache::isRunning() const -> bool
+{
+    return m_thread && m_thread->isRunning();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageCache::isEnabled() -> bool
+{
+    QSettings settings;
+    return settings.value(UseImageCacheKey, false).toBool();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ImageCache::setEnabled(bool enabled)
+{
+    QSettings settings;
+    settings.setValue(UseImageCacheKey, enabled);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageCache::sizeLimit() -> int
+{
+    QSettings settings;
+    return settings.value(ImageCacheSizeKey, DefaultSizeLimit).toInt();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ImageCache::setSizeLimit(int megabytes)
+{
+    QSettings settings;
+    settings.setValue(ImageCacheSizeKey, megabytes);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageCache::isCacheable(const QString& filename) -> bool
+{
+    // Other containers (CSO, ECM, DAA, ...) are only understood by the daemon itself
+    const QString suffix = QFileInfo(filename).suffix().toLower();
+    return (suffix == "gz" || suffix == "xz") && !innerSuffix(filename).isEmpty();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageCache::isCached(const QString& filename) -> bool
+{
+    QSettings index(directory() + "/index.ini", QSettings::IniFormat);
+    return !lookup(index, filename).isEmpty();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageCache::resolve(const QString& filename) -> QString
+{
+    if (!isEnabled() || !isCacheable(filename))
+        return filename;
+
+    QSettings index(directory() + "/index.ini", QSettings::IniFormat);
+
+    const QString key = lookup(index, filename);
+
+    if (key.isEmpty())
+        return filename;
+
+    index.beginGroup(ImagesGroup);
+    index.beginGroup(key);
+    index.setValue(LastUsedKey, QDateTime::currentSecsSinceEpoch());
+
+    return directory() + "/" + index.value(FileKey).toString();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageCache::originalPath(const QString& filename) -> QString
+{
+    const QFileInfo info(filename);
+
+    if (filename.isEmpty() || info.path() != directory())
+        return filename;
+
+    QSettings index(directory() + "/index.ini", QSettings::IniFormat);
+
+    index.beginGroup(ImagesGroup);
+    index.beginGroup(info.completeBaseName());
+
+    const QString source = index.value(SourceKey).toString();
+
+    return source.isEmpty() ? filename : source;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ImageCache::release(const QStringList& loadedFiles)
+{
+    QSettings index(directory() + "/index.ini", QSettings::IniFormat);
+    evict(index, loadedFiles);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ImageCache::expand(const QString& filename, const std::atomic<bool>* stopping)
+{
+    if (!isCacheable(filename))
+        return;
+
+    if (!QDir().mkpath(directory()))
+        throw Exception(Error::DecompressionFailed);
+
+    const QString identity = ImageFile::identity(filename);
+
+    {
+        QSettings index(directory() + "/index.ini", QSettings::IniFormat);
+
+        if (!lookup(index, filename).isEmpty())
+            return;
+    }
+
+    // Unique per expansion, so that concurrent ones never write to the same file
+    QTemporaryFile partial(directory() + "/XXXXXX.part");
+
+    if (!partial.open())
+        throw Exception(Error::DecompressionFailed);
+
+    const QStringList command = decompressor(QFileInfo(filename).suffix().toLower());
+
+    QProcess process;
+    process.setStandardErrorFile(QProcess::nullDevice());
+    process.start(command.first(), command.mid(1) << filename);
+
+    // Entries are keyed by content so that copies of an image share a single expanded file. The
+    // digest is taken from the output as it streams through rather than by reading the input twice.
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    bool written = true;
+
+    const auto drain = [&process, &partial, &hash, &written] {
+        const QByteArray data = process.readAllStandardOutput();
+
+        hash.addData(data);
+        written = written && partial.write(data) == data.size();
+    };
+
+    while (process.state() != QProcess::NotRunning)
+    {
+        if (stopping && *stopping)
+        {
+            process.kill();
+            process.waitForFinished();
+
+            throw Exception(Error::DecompressionFailed);
+        }
+
+        if (process.waitForReadyRead(PollInterval))
+            drain();
+    }
+
+    drain();
+
+    const bool success = written && partial.flush() &&
+                         process.exitStatus() == QProcess::NormalExit && process.exitCode() == 0;
+
+    if (!success)
+        throw Exception(Error::DecompressionFailed);
+
+    const QString key = QString::fromLatin1(hash.result().toHex());
+    const QString name = key + "." + innerSuffix(filename);
+    const QString path = directory() + "/" + name;
+
+    // Another copy of the same content may have been expanded in the meantime
+    if (!QFile::exists(path))
+    {
+        if (partial.rename(path))
+            partial.setAutoRemove(false);
+        else if (!QFile::exists(path))
+            throw Exception(Error::DecompressionFailed);
+    }
+
+    QSettings index(directory() + "/index.ini", QSettings::IniFormat);
+
+    index.setValue(QString(SourcesGroup) + "/" + identity, key);
+
+    index.beginGroup(ImagesGroup);
+    index.beginGroup(key);
+    index.setValue(FileKey, name);
+    index.setValue(SizeKey, QFileInfo(path).size());
+    index.setValue(SourceKey, filename);
+    index.setValue(LastUsedKey, QDateTime::currentSecsSinceEpoch());
+    index.endGroup();
+    index.endGroup();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageCache::directory() -> QString
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/images";
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageCache::lookup(QSettings& index, const QString& filename) -> QString
+{
+    const QString identity = ImageFile::identity(filename);
+
+    if (identity.isEmpty())
+        return QString();
+
+    const QString key = index.value(QString(SourcesGroup) + "/" + identity).toString();
+
+    if (key.isEmpty())
+        return QString();
+
+    const QString file = index.value(QString(ImagesGroup) + "/" + key + "/" + FileKey).toString();
+
+    if (file.isEmpty() || !QFile::exists(directory() + "/" + file))
+        return QString();
+
+    return key;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ImageCache::evict(QSettings& index, const QStringList& loadedFiles)
+{
+    const qint64 limit = qint64(sizeLimit()) * 1024 * 1024;
+
+    index.beginGroup(ImagesGroup);
+
+    QList<QPair<qint64, QString>> entries;
+    qint64 total = 0;
+
+    for (const QString& key : index.childGroups())
+    {
+        total += index.value(key + "/" + SizeKey).toLongLong();
+        entries << qMakePair(index.value(key + "/" + LastUsedKey).toLongLong(), key);
+    }
+
+    // Least recently used first
+    std::sort(entries.begin(), entries.end());
+
+    // The latest entry stays even if it exceeds the limit by itself
+    if (!entries.isEmpty())
+        entries.removeLast();
+
+    QSet<QString> evicted;
+
+    for (const auto& entry : entries)
+    {
+        if (total <= limit)
+            break;
+
+        const QString file = directory() + "/" +
+                             index.value(entry.second + "/" + FileKey).toString();
+
+        // Pulling the file out from under the daemon would break the mounted image
+        if (loadedFiles.contains(file))
+            continue;
+
+        total -= index.value(entry.second + "/" + SizeKey).toLongLong();
+
+        QFile::remove(file);
+        index.remove(entry.second);
+
+        evicted.insert(entry.second);
+    }
+
+    index.endGroup();
+
+    if (evicted.isEmpty())
+        return;
+
+    index.beginGroup(SourcesGroup);
+
+    for (const QString& identity : index.childKeys())
+    {
+        if (evicted.contains(index.value(identity).toString()))
+            index.remove(identity);
+    }
+
+    index.endGroup();
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,73 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include <QObject>
+#include <QStringList>
+
+#include <atomic>
+
+class QSettings;
+class QThread;
+
+class ImageCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    ImageCache(QObject* parent = nullptr);
+    ~ImageCache() override;
+
+    void start(const QString& filename);
+    auto isRunning() const -> bool;
+
+    static auto isEnabled() -> bool;
+    static void setEnabled(bool enabled);
+
+    static auto sizeLimit() -> int;
+    static void setSizeLimit(int megabytes);
+
+    static auto isCacheable(const QString& filename) -> bool;
+    static auto isCached(const QString& filename) -> bool;
+
+    static auto resolve(const QString& filename) -> QString;
+    static auto originalPath(const QString& filename) -> QString;
+
+    static void release(const QStringList& loadedFiles);
+
+    static void expand(const QString& filename, const std::atomic<bool>* stopping = nullptr);
+
+signals:
+    void finished(const QString& filename, bool success);
+
+private:
+    static auto directory() -> QString;
+    static auto lookup(QSettings& index, const QString& filename) -> QString;
+    static void evict(QSettings& index, const QStringList& loadedFiles);
+
+private:
+    QThread* m_thread = nullptr;
+    std::atomic<bool> m_stopping;
+};
+
+#endif // IMAGECACHE_H
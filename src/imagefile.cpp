@@ -0,0 +1,184 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "imagefile.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+
+#include <algorithm>
+#include <iterator>
+
+#include <sys/stat.h>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr qint64 MaxDescriptorSize = 1024 * 1024;
+
+    constexpr const char* ImageSuffixes[] = {
+        "mds", "mdx", "b5t", "b6t", "ccd", "sub", "img", "cue", "bin",
+        "toc", "cdi", "cif", "c2d", "iso", "nrg", "udf"
+    };
+
+    // Track files that are only mountable when nothing describes them
+    constexpr const char* DescriptorSuffixes[] = { "cue", "toc", "ccd" };
+
+    // ISO 9660 and UDF volume descriptors both start in the 17th sector
+    constexpr qint64 VolumeDescriptorOffset = 16 * 2048 + 1;
+
+    auto findCompanion(const QFileInfo& info, const QString& suffix) -> QString
+    {
+        for (const QString& candidate : { suffix, suffix.toUpper() })
+        {
+            const QString path = info.dir().absoluteFilePath(info.completeBaseName() + "." +
+                                                             candidate);
+
+            if (QFile::exists(path))
+                return path;
+        }
+
+        return QString();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageFile::identity(const QString& filename) -> QString
+{
+    // Identifies a particular revision of a file without reading its contents
+    struct stat info = {};
+
+    if (stat(QFile::encodeName(filename).constData(), &info) != 0)
+        return QString();
+
+    return QString("%1-%2-%3-%4.%5").arg(info.st_dev).arg(info.st_ino).arg(info.st_size)
+                                    .arg(info.st_mtim.tv_sec).arg(info.st_mtim.tv_nsec);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageFile::trackFiles(const QString& filename) -> QStringList
+{
+    // Returns the data files an image descriptor refers to, excluding the descriptor itself
+    const QFileInfo info(filename);
+    const QString suffix = info.suffix().toLower();
+
+    QStringList files;
+
+    if (suffix == "cue" || suffix == "toc")
+    {
+        QFile file(filename);
+
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            return files;
+
+        const QString content = QString::fromLocal8Bit(file.read(MaxDescriptorSize));
+
+        static const QRegularExpression pattern(
+                R"(^\s*(?:FILE|DATAFILE)\s+(?:"([^"]+)"|(\S+)))",
+                QRegularExpression::CaseInsensitiveOption | QRegularExpression::MultilineOption);
+
+        QRegularExpressionMatchIterator it = pattern.globalMatch(content);
+
+        while (it.hasNext())
+        {
+            const QRegularExpressionMatch match = it.next();
+            const QString name = match.captured(1).isEmpty() ? match.captured(2)
+                                                             : match.captured(1);
+
+            files << info.dir().absoluteFilePath(name);
+        }
+    }
+    else if (suffix == "mds")
+        files << findCompanion(info, "mdf");
+    else if (suffix == "ccd")
+        files << findCompanion(info, "img") << findCompanion(info, "sub");
+    else if (suffix == "b5t")
+        files << findCompanion(info, "b5i");
+    else if (suffix == "b6t")
+        files << findCompanion(info, "b6i");
+
+    files.removeAll(QString());
+    files.removeAll(info.absoluteFilePath());
+    files.removeDuplicates();
+
+    return files;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageFile::dataFile(const QString& filename) -> QString
+{
+    // Descriptors like CUE or MDS only point to the file holding the actual data
+    const QStringList tracks = trackFiles(filename);
+    return tracks.isEmpty() ? filename : tracks.first();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageFile::isImage(const QString& filename) -> bool
+{
+    // Cheap enough to run on every file that shows up in a watched folder
+    const QFileInfo info(filename);
+    const QString suffix = info.suffix().toLower();
+
+    if (!info.isFile() || info.size() == 0)
+        return false;
+
+    if (!hasImageSuffix(filename))
+        return false;
+
+    if (suffix == "bin" || suffix == "img" || suffix == "sub")
+    {
+        for (const char* descriptor : DescriptorSuffixes)
+        {
+            if (!findCompanion(info, descriptor).isEmpty())
+                return false;
+        }
+    }
+    else if (suffix == "iso")
+    {
+        QFile file(filename);
+
+        if (!file.open(QIODevice::ReadOnly) || !file.seek(VolumeDescriptorOffset))
+            return false;
+
+        const QByteArray magic = file.read(5);
+        return magic == "CD001" || magic == "BEA01";
+    }
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageFile::hasImageSuffix(const QString& filename) -> bool
+{
+    // Only looks at the name, e.g. for files inside an archive
+    const QString suffix = QFileInfo(filename).suffix().toLower();
+    return std::find(std::begin(ImageSuffixes), std::end(ImageSuffixes), suffix) !=
+           std::end(ImageSuffixes);
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,421 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "exception.h"
+#include "hotset.h"
+#include "imagefile.h"
+#include "imageverifier.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QSettings>
+#include <QThread>
+
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include <sys/mman.h>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr qint64 ChunkSize = 64 * 1024 * 1024;
+    constexpr int MaxCacheSize = 500;
+
+    constexpr const char* ChecksumsGroup = "ImageChecksums";
+    constexpr const char* VerifiedAtKey = "verifiedAt";
+    constexpr const char* RequireVerifiedKey = "requireVerified";
+
+    const QStringList Algorithms = { "md5", "sha1", "sha256", "crc32" };
+
+    class Hasher
+    {
+    public:
+        virtual ~Hasher() = default;
+
+        virtual void addData(const uchar* data, qint64 length) = 0;
+        virtual auto result() const -> QString = 0;
+    };
+
+    class CryptographicHasher : public Hasher
+    {
+    public:
+        CryptographicHasher(QCryptographicHash::Algorithm algorithm)
+            : m_hash(algorithm) {}
+
+        void addData(const uchar* data, qint64 length) override
+        {
+            m_hash.addData(QByteArrayView(data, length));
+        }
+
+        auto result() const -> QString override
+        {
+            return QString::fromLatin1(m_hash.result().toHex());
+        }
+
+    private:
+        QCryptographicHash m_hash;
+    };
+
+    class Crc32Hasher : public Hasher
+    {
+    public:
+        Crc32Hasher()
+        {
+            for (quint32 i = 0; i < 256; ++i)
+            {
+                quint32 value = i;
+
+                for (int k = 0; k < 8; ++k)
+                    value = (value & 1) ? (0xedb88320u ^ (value >> 1)) : (value >> 1);
+
+                m_table[i] = value;
+            }
+        }
+
+        void addData(const uchar* data, qint64 length) override
+        {
+            quint32 crc = m_crc;
+
+            for (qint64 i = 0; i < length; ++i)
+                crc = m_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+            m_crc = crc;
+        }
+
+        auto result() const -> QString override
+        {
+            return QString("%1").arg(m_crc ^ 0xffffffffu, 8, 16, QChar('0'));
+        }
+
+    private:
+        quint32 m_table[256];
+        quint32 m_crc = 0xffffffffu;
+    };
+
+    auto createHasher(const QString& algorithm) -> std::unique_ptr<Hasher>
+    {
+        if (algorithm == "md5")
+            return std::make_unique<CryptographicHasher>(QCryptographicHash::Md5);
+
+        if (algorithm == "sha1")
+            return std::make_unique<CryptographicHasher>(QCryptographicHash::Sha1);
+
+        if (algorithm == "sha256")
+            return std::make_unique<CryptographicHasher>(QCryptographicHash::Sha256);
+
+        return std::make_unique<Crc32Hasher>();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+ImageVerifier::ImageVerifier(QObject* parent)
+    : QObject(parent) {}
+
+// ---------------------------------------------------------------------------------------------- //
+
+ImageVerifier::~ImageVerifier()
+{
+    if (m_thread)
+    {
+        m_thread->wait();
+        delete m_thread;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ImageVerifier::start(const QString& filename)
+{
+    Q_ASSERT(!isRunning());
+
+    delete m_thread;
+
+    m_thread = QThread::create([this, filename] {
+        const HotSet::Reader reader(filename);
+
+        Result result = Result::Failed;
+
+        try {
+            const Report report = verify(filename, [this](int percent) {
+                emit progressChanged(percent);
+            });
+
+            result = report.result;
+        }
+        catch (const Exception& e) {
+            qDebug() << "Unable to verify image:" << e.what();
+        }
+
+        emit finished(filename, result);
+    });
+
+    m_thread->start();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageVerifier::isRunning() const -> bool
+{
+    return m_thread && m_thread->isRunning();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageVerifier::verify(const QString& filename, const ProgressCallback& progress) -> Report
+{
+    if (!QFile::exists(filename))
+        throw Exception(Error::FileNotFound);
+
+    const QString identity = ImageFile::identity(filename);
+    const QMap<QString, QString> references = readSidecars(filename);
+
+    QMap<QString, QString> checksums = lookupCache(identity);
+
+    // Only what the checksum files ask for and hasn't been computed before
+    QStringList algorithms;
+
+    for (const QString& algorithm : references.keys())
+    {
+        if (!checksums.contains(algorithm))
+            algorithms << algorithm;
+    }
+
+    const bool cached = algorithms.isEmpty();
+
+    if (!cached)
+    {
+        const QMap<QString, QString> computed = computeChecksums(filename, algorithms, progress);
+
+        for (auto it = computed.cbegin(); it != computed.cend(); ++it)
+            checksums.insert(it.key(), it.value());
+
+        // Don't cache results for a file that was modified while we were reading it
+        if (ImageFile::identity(filename) == identity)
+            storeCache(identity, checksums);
+    }
+    else if (progress)
+        progress(100);
+
+    Report report = compare(checksums, references);
+    report.cached = cached && !references.isEmpty();
+
+    return report;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageVerifier::isVerified(const QString& filename) -> bool
+{
+    const QMap<QString, QString> checksums = lookupCache(ImageFile::identity(filename));
+
+    if (checksums.isEmpty())
+        return false;
+
+    return compare(checksums, readSidecars(filename)).result == Result::Verified;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageVerifier::isRequired() -> bool
+{
+    QSettings settings;
+    return settings.value(RequireVerifiedKey, false).toBool();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ImageVerifier::setRequired(bool required)
+{
+    QSettings settings;
+    settings.setValue(RequireVerifiedKey, required);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageVerifier::computeChecksums(const QString& filename, const QStringList& algorithms,
+                                     const ProgressCallback& progress) -> QMap<QString, QString>
+{
+    QFile file(filename);
+
+    if (!file.open(QIODevice::ReadOnly))
+        throw Exception(Error::FileNotReadable);
+
+    std::vector<std::unique_ptr<Hasher>> hashers;
+
+    for (const QString& algorithm : algorithms)
+        hashers.push_back(createHasher(algorithm));
+
+    const qint64 size = file.size();
+
+    for (qint64 offset = 0; offset < size; offset += ChunkSize)
+    {
+        const qint64 length = qMin(ChunkSize, size - offset);
+
+        uchar* data = file.map(offset, length);
+
+        if (!data)
+            throw Exception(Error::FileNotReadable);
+
+        posix_madvise(data, length, POSIX_MADV_WILLNEED);
+
+        // A digest can't be split across cores, so each algorithm gets a worker of its own
+        std::vector<std::future<void>> workers;
+
+        for (size_t i = 1; i < hashers.size(); ++i)
+        {
+            Hasher* hasher = hashers[i].get();
+
+            workers.push_back(std::async(std::launch::async, [hasher, data, length] {
+                hasher->addData(data, length);
+            }));
+        }
+
+        hashers.front()->addData(data, length);
+
+        for (auto& worker : workers)
+            worker.get();
+
+        file.unmap(data);
+
+        if (progress)
+            progress(int((offset + length) * 100 / size));
+    }
+
+    QMap<QString, QString> checksums;
+
+    for (int i = 0; i < algorithms.size(); ++i)
+        checksums.insert(algorithms.at(i), hashers.at(i)->result());
+
+    return checksums;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageVerifier::readSidecars(const QString& filename) -> QMap<QString, QString>
+{
+    QMap<QString, QString> references;
+
+    for (const QString& algorithm : Algorithms)
+    {
+        // Accepts both plain checksums and "<checksum>  <filename>" lines as written by sha256sum
+        QFile sidecar(filename + "." + algorithm);
+
+        if (!sidecar.open(QIODevice::ReadOnly | QIODevice::Text))
+            continue;
+
+        const QString line = QString::fromLatin1(sidecar.readLine()).simplified();
+        const QString checksum = line.section(' ', 0, 0).toLower();
+
+        if (!checksum.isEmpty())
+            references.insert(algorithm, checksum);
+    }
+
+    return references;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageVerifier::compare(const QMap<QString, QString>& checksums,
+                            const QMap<QString, QString>& references) -> Report
+{
+    Report report = { Result::NoReference, checksums, QStringList(), false };
+
+    if (references.isEmpty())
+        return report;
+
+    for (auto it = references.cbegin(); it != references.cend(); ++it)
+    {
+        if (checksums.value(it.key()) != it.value())
+            report.mismatches << it.key();
+    }
+
+    report.result = report.mismatches.isEmpty() ? Result::Verified : Result::Mismatch;
+
+    return report;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageVerifier::lookupCache(const QString& identity) -> QMap<QString, QString>
+{
+    QMap<QString, QString> checksums;
+
+    if (identity.isEmpty())
+        return checksums;
+
+    QSettings settings;
+    settings.beginGroup(ChecksumsGroup);
+
+    const QVariantMap entry = settings.value(identity).toMap();
+
+    // Entries only hold the algorithms that have been asked for so far
+    for (const QString& algorithm : Algorithms)
+    {
+        if (entry.contains(algorithm))
+            checksums.insert(algorithm, entry.value(algorithm).toString());
+    }
+
+    return checksums;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ImageVerifier::storeCache(const QString& identity, const QMap<QString, QString>& checksums)
+{
+    if (identity.isEmpty())
+        return;
+
+    QSettings settings;
+    settings.beginGroup(ChecksumsGroup);
+
+    QVariantMap entry;
+
+    for (auto it = checksums.cbegin(); it != checksums.cend(); ++it)
+        entry.insert(it.key(), it.value());
+
+    entry.insert(VerifiedAtKey, QDateTime::currentSecsSinceEpoch());
+    settings.setValue(identity, entry);
+
+    // Limit size by dropping the oldest entries
+    const QStringList keys = settings.childKeys();
+
+    if (keys.size() <= MaxCacheSize)
+        return;
+
+    std::vector<std::pair<qint64, QString>> entries;
+    entries.reserve(keys.size());
+
+    for (const QString& key : keys)
+        entries.emplace_back(settings.value(key).toMap().value(VerifiedAtKey).toLongLong(), key);
+
+    std::sort(entries.begin(), entries.end());
+
+    for (size_t i = 0; i < entries.size() - MaxCacheSize; ++i)
+        settings.remove(entries.at(i).second);
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,92 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef IMAGEVERIFIER_H
+#define IMAGEVERIFIER_H
+
+#include <QMap>
+#include <QObject>
+#include <QStringList>
+
+#include <functional>
+
+class QThread;
+
+class ImageVerifier : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Result
+    {
+        Verified,
+        Mismatch,
+        NoReference,
+        Failed
+    };
+    Q_ENUM(Result)
+
+    struct Report
+    {
+        Result result;
+        QMap<QString, QString> checksums;
+        QStringList mismatches;
+        bool cached;
+    };
+
+    using ProgressCallback = std::function<void(int)>;
+
+public:
+    ImageVerifier(QObject* parent = nullptr);
+    ~ImageVerifier() override;
+
+    void start(const QString& filename);
+    auto isRunning() const -> bool;
+
+    static auto verify(const QString& filename,
+                       const ProgressCallback& progress = ProgressCallback()) -> Report;
+
+    static auto isVerified(const QString& filename) -> bool;
+
+    static auto isRequired() -> bool;
+    static void setRequired(bool required);
+
+signals:
+    void progressChanged(int percent);
+    void finished(const QString& filename, ImageVerifier::Result result);
+
+private:
+    static auto computeChecksums(const QString& filename, const QStringList& algorithms,
+                                 const ProgressCallback& progress) -> QMap<QString, QString>;
+
+    static auto readSidecars(const QString& filename) -> QMap<QString, QString>;
+
+    static auto compare(const QMap<QString, QString>& checksums,
+                        const QMap<QString, QString>& references) -> Report;
+
+    static auto lookupCache(const QString& identity) -> QMap<QString, QString>;
+    static void storeCache(const QString& identity, const QMap<QString, QString>& checksums);
+
+private:
+    QThread* m_thread = nullptr;
+};
+
+#endif // IMAGEVERIFIER_H
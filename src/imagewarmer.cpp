@@ -0,0 +1,345 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "hotset.h"
+#include "imagefile.h"
+#include "imagewarmer.h"
+
+#include <QFile>
+#include <QList>
+#include <QPair>
+#include <QSettings>
+#include <QThread>
+#include <QtEndian>
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr int DefaultWarmUpSize = 16; // MiB
+
+    constexpr qint64 SectorSize = 2048;
+    constexpr qint64 VolumeDescriptorStart = 16;
+    constexpr qint64 UdfAnchor = 256;
+
+    constexpr int MaxVolumeDescriptors = 32;
+    constexpr int MaxDirectories = 4096;
+    constexpr qint64 MaxPathTableSize = 1024 * 1024;
+
+    constexpr const char* WarmUpImagesKey = "warmUpImages";
+    constexpr const char* WarmUpSizeKey = "warmUpSize";
+
+    struct Layout
+    {
+        qint64 sectorSize;
+        qint64 headerSize;
+    };
+
+    // Cooked ISO, raw Mode 1 and raw Mode 2 Form 1 sectors
+    constexpr Layout Layouts[] = { { 2048, 0 }, { 2352, 16 }, { 2352, 24 } };
+
+    class Image
+    {
+    public:
+        Image(int fd)
+            : m_fd(fd),
+              m_size(lseek(fd, 0, SEEK_END)) {}
+
+        auto detectLayout() -> bool
+        {
+            for (const Layout& layout : Layouts)
+            {
+                m_layout = layout;
+
+                char sector[SectorSize];
+
+                if (!readSector(VolumeDescriptorStart, sector))
+                    continue;
+
+                // ISO 9660 or UDF volume recognition sequence
+                const QByteArray id(sector + 1, 5);
+
+                if (id == "CD001" || id == "BEA01")
+                    return true;
+            }
+
+            return false;
+        }
+
+        auto readSector(qint64 lba, char* data) const -> bool
+        {
+            const qint64 offset = lba * m_layout.sectorSize + m_layout.headerSize;
+            return pread(m_fd, data, SectorSize, offset) == SectorSize;
+        }
+
+        void addSectors(qint64 lba, qint64 length)
+        {
+            const qint64 count = qMax<qint64>(1, (length + SectorSize - 1) / SectorSize);
+            addRange(lba * m_layout.sectorSize, count * m_layout.sectorSize);
+        }
+
+        void addRange(qint64 offset, qint64 length)
+        {
+            m_ranges << qMakePair(offset, length);
+        }
+
+        auto advise() -> qint64
+        {
+            std::sort(m_ranges.begin(), m_ranges.end());
+
+            qint64 total = 0;
+            qint64 start = -1;
+            qint64 end = -1;
+
+            // Merge overlapping ranges so that every byte is only counted once
+            for (const auto& range : m_ranges)
+            {
+                if (range.first > end)
+                {
+                    total += flush(start, end);
+                    start = range.first;
+                }
+
+                end = qMax(end, range.first + range.second);
+            }
+
+            total += flush(start, end);
+
+            return total;
+        }
+
+    private:
+        auto flush(qint64 start, qint64 end) const -> qint64
+        {
+            end = qMin(end, m_size);
+
+            if (start < 0 || end <= start)
+                return 0;
+
+            if (posix_fadvise(m_fd, start, end - start, POSIX_FADV_WILLNEED) != 0)
+                return 0;
+
+            return end - start;
+        }
+
+    private:
+        int m_fd;
+        qint64 m_size;
+        Layout m_layout = Layouts[0];
+        QList<QPair<qint64, qint64>> m_ranges;
+    };
+
+    void addDirectory(Image& image, qint64 lba)
+    {
+        // The first record of a directory describes the directory itself
+        char sector[SectorSize];
+
+        if (!image.readSector(lba, sector))
+            return;
+
+        image.addSectors(lba, qFromLittleEndian<quint32>(sector + 10));
+    }
+
+    void addPathTable(Image& image, qint64 lba, qint64 size)
+    {
+        size = qMin(size, MaxPathTableSize);
+        image.addSectors(lba, size);
+
+        QByteArray table;
+
+        for (qint64 offset = 0; offset < size; offset += SectorSize)
+        {
+            char sector[SectorSize];
+
+            if (!image.readSector(lba + offset / SectorSize, sector))
+                break;
+
+            table.append(sector, SectorSize);
+        }
+
+        table.truncate(size);
+
+        int count = 0;
+        int offset = 0;
+
+        while (offset + 8 <= table.size() && count++ < MaxDirectories)
+        {
+            const int nameLength = quint8(table.at(offset));
+
+            if (nameLength == 0)
+                break;
+
+            addDirectory(image, qFromLittleEndian<quint32>(table.constData() + offset + 2));
+
+            offset += 8 + nameLength + (nameLength % 2);
+        }
+    }
+
+    void addIso9660(Image& image)
+    {
+        for (int i = 0; i < MaxVolumeDescriptors; ++i)
+        {
+            const qint64 lba = VolumeDescriptorStart + i;
+
+            char sector[SectorSize];
+
+            if (!image.readSector(lba, sector))
+                return;
+
+            image.addSectors(lba, SectorSize);
+
+            const quint8 type = quint8(sector[0]);
+
+            if (type == 255) // Terminator
+                return;
+
+            // Primary and supplementary (Joliet) descriptors
+            if (type != 1 && type != 2)
+                continue;
+
+            if (QByteArray(sector + 1, 5) != "CD001")
+                continue;
+
+            const qint64 pathTableSize = qFromLittleEndian<quint32>(sector + 132);
+            const qint64 pathTable = qFromLittleEndian<quint32>(sector + 140);
+            const qint64 rootDirectory = qFromLittleEndian<quint32>(sector + 156 + 2);
+
+            addPathTable(image, pathTable, pathTableSize);
+            addDirectory(image, rootDirectory);
+        }
+    }
+
+    void addUdf(Image& image)
+    {
+        char sector[SectorSize];
+
+        if (!image.readSector(UdfAnchor, sector))
+            return;
+
+        // Anchor volume descriptor pointer
+        if (qFromLittleEndian<quint16>(sector) != 2)
+            return;
+
+        image.addSectors(UdfAnchor, SectorSize);
+
+        // Main and reserve volume descriptor sequences
+        image.addSectors(qFromLittleEndian<quint32>(sector + 20),
+                         qFromLittleEndian<quint32>(sector + 16));
+
+        image.addSectors(qFromLittleEndian<quint32>(sector + 28),
+                         qFromLittleEndian<quint32>(sector + 24));
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+ImageWarmer::ImageWarmer(QObject* parent)
+    : QObject(parent) {}
+
+// ---------------------------------------------------------------------------------------------- //
+
+ImageWarmer::~ImageWarmer()
+{
+    if (m_thread)
+    {
+        m_thread->wait();
+        delete m_thread;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ImageWarmer::start(const QString& filename)
+{
+    Q_ASSERT(!isRunning());
+
+    delete m_thread;
+
+    m_thread = QThread::create([this, filename] {
+        const HotSet::Reader reader(filename);
+        emit finished(filename, warmUp(filename));
+    });
+
+    m_thread->start(QThread::LowPriority);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageWarmer::isRunning() const -> bool
+{
+    return m_thread && m_thread->isRunning();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageWarmer::isEnabled() -> bool
+{
+    QSettings settings;
+    return settings.value(WarmUpImagesKey, false).toBool();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void ImageWarmer::setEnabled(bool enabled)
+{
+    QSettings settings;
+    settings.setValue(WarmUpImagesKey, enabled);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageWarmer::warmUpSize() -> int
+{
+    QSettings settings;
+    return settings.value(WarmUpSizeKey, DefaultWarmUpSize).toInt();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto ImageWarmer::warmUp(const QString& filename) -> qint64
+{
+    const QString dataFile = ImageFile::dataFile(filename);
+    const int fd = open(QFile::encodeName(dataFile).constData(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return 0;
+
+    Image image(fd);
+    image.addRange(0, qint64(warmUpSize()) * 1024 * 1024);
+
+    if (image.detectLayout())
+    {
+        addIso9660(image);
+        addUdf(image);
+    }
+
+    const qint64 bytes = image.advise();
+
+    close(fd);
+
+    return bytes;
+}
+
+// ---------------------------------------------------------------------------------------------- //
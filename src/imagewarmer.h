@@ -0,0 +1,54 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef IMAGEWARMER_H
+#define IMAGEWARMER_H
+
+#include <QObject>
+
+class QThread;
+
+class ImageWarmer : public QObject
+{
+    Q_OBJECT
+
+public:
+    ImageWarmer(QObject* parent = nullptr);
+    ~ImageWarmer() override;
+
+    void start(const QString& filename);
+    auto isRunning() const -> bool;
+
+    static auto isEnabled() -> bool;
+    static void setEnabled(bool enabled);
+
+    static auto warmUpSize() -> int;
+
+    static auto warmUp(const QString& filename) -> qint64;
+
+signals:
+    void finished(const QString& filename, qint64 bytes);
+
+private:
+    QThread* m_thread = nullptr;
+};
+
+#endif // IMAGEWARMER_H
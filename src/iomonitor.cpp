@@ -0,0 +1,163 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "iomonitor.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr int MinInterval = 500;  // ms
+    constexpr int MaxInterval = 8000; // ms
+
+    constexpr qint64 SectorSize = 512; // Unit of the sector counters in sysfs
+
+    auto monotonicTime() -> qint64
+    {
+        static QElapsedTimer timer;
+
+        if (!timer.isValid())
+            timer.start();
+
+        return timer.elapsed();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+IoMonitor::IoMonitor(QObject* parent)
+    : QObject(parent),
+      m_timer(this)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setInterval(MinInterval);
+
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void IoMonitor::setDevices(const QStringList& nodes)
+{
+    m_nodes = nodes;
+
+    m_samples.clear();
+    m_statistics.clear();
+
+    for (const QString& node : m_nodes)
+        m_samples.insert(node, sample(node));
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void IoMonitor::start()
+{
+    // Fresh baseline, so that the first update doesn't cover the time spent stopped
+    setDevices(m_nodes);
+
+    m_timer.setInterval(MinInterval);
+    m_timer.start();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void IoMonitor::stop()
+{
+    m_timer.stop();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto IoMonitor::statistics(const QString& node) const -> Statistics
+{
+    return m_statistics.value(node, { 0.0, 0.0, 0 });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto IoMonitor::sample(const QString& node) -> Sample
+{
+    Sample result = { false, monotonicTime(), 0, 0, 0 };
+
+    if (node.isEmpty())
+        return result;
+
+    QFile file("/sys/block/" + QFileInfo(node).fileName() + "/stat");
+
+    if (!file.open(QIODevice::ReadOnly))
+        return result;
+
+    // See Documentation/block/stat.rst in the kernel sources
+    const QStringList fields = QString::fromLatin1(file.readAll()).simplified().split(' ');
+
+    if (fields.size() < 9)
+        return result;
+
+    result.valid = true;
+    result.reads = fields.at(0).toLongLong();
+    result.sectors = fields.at(2).toLongLong();
+    result.inFlight = fields.at(8).toInt();
+
+    return result;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto IoMonitor::compare(const Sample& first, const Sample& second) -> Statistics
+{
+    const double seconds = (second.time - first.time) / 1000.0;
+
+    if (!first.valid || !second.valid || seconds <= 0.0)
+        return { 0.0, 0.0, second.inFlight };
+
+    return { (second.reads - first.reads) / seconds,
+             (second.sectors - first.sectors) * SectorSize / seconds,
+             second.inFlight };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void IoMonitor::onTimeout()
+{
+    bool active = false;
+
+    for (const QString& node : m_nodes)
+    {
+        const Sample current = sample(node);
+        const Statistics statistics = compare(m_samples.value(node), current);
+
+        m_samples.insert(node, current);
+        m_statistics.insert(node, statistics);
+
+        active = active || statistics.readsPerSecond > 0.0 || statistics.inFlight > 0;
+    }
+
+    // Sample often while drives are busy and back off while they're idle
+    m_timer.setInterval(active ? MinInterval : qMin(m_timer.interval() * 2, MaxInterval));
+    m_timer.start();
+
+    emit updated();
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,78 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef IOMONITOR_H
+#define IOMONITOR_H
+
+#include <QMap>
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+
+class IoMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Sample
+    {
+        bool valid;
+        qint64 time;
+        qint64 reads;
+        qint64 sectors;
+        int inFlight;
+    };
+
+    struct Statistics
+    {
+        double readsPerSecond;
+        double bytesPerSecond;
+        int inFlight;
+    };
+
+public:
+    IoMonitor(QObject* parent = nullptr);
+
+    void setDevices(const QStringList& nodes);
+
+    void start();
+    void stop();
+
+    auto statistics(const QString& node) const -> Statistics;
+
+    static auto sample(const QString& node) -> Sample;
+    static auto compare(const Sample& first, const Sample& second) -> Statistics;
+
+signals:
+    void updated();
+
+private slots:
+    void onTimeout();
+
+private:
+    QTimer m_timer;
+
+    QStringList m_nodes;
+    QMap<QString, Sample> m_samples;
+    QMap<QString, Statistics> m_statistics;
+};
+
+#endif // IOMONITOR_H
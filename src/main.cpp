@@ -25,64 +25,744 @@
 
 #include <QApplication>
 #include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QInputDialog>
+#include <QProcess>
+#include <QThread>
 #include <QTextStream>
+#include <QTimer>
 
+#include "archiveextractor.h"
+#include "batchsession.h"
 #include "cdemu.h"
+#include "deviceprofile.h"
+#include "devicewaiter.h"
+#include "discset.h"
+#include "drivebenchmark.h"
+#include "eventtrace.h"
+#include "hotset.h"
+#include "imagecache.h"
+#include "imagefile.h"
+#include "imageverifier.h"
+#include "imagewarmer.h"
+#include "iomonitor.h"
 #include "kdecdemuversion.h"
 #include "mainwindow.h"
 #include "messagebox.h"
+#include "mountjournal.h"
+#include "ramstaging.h"
+#include "startupprofile.h"
+#include "trafficrecorder.h"
+#include "trafficreplay.h"
+#include "trayicon.h"
+#include "watchfolder.h"
+
+#include <memory>
+#include <vector>
+
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------------------------- //
+
+struct MountOptions
+{
+    bool ram = false;
+    bool forceNew = false;
+    bool chooseImage = false;
+    QString profile;
+    QVariantMap deviceOptions;
+};
+
+struct MountedDevice
+{
+    const CDEmu* cdemu;
+    int index;
+};
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto parseDeviceOptions(const QStringList& values) -> QVariantMap
+{
+    QVariantMap options;
+
+    for (const QString& value : values)
+    {
+        const QString key = value.section('=', 0, 0).trimmed();
+
+        if (!value.contains('=') || !CDEmu::optionNames().contains(key))
+            throw Exception(Error::InvalidOption);
+
+        options.insert(key, value.section('=', 1));
+    }
+
+    return options;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static void setDeviceOptions(const CDEmu& cdemu, int index, const QVariantMap& options)
+{
+    if (index >= 0)
+    {
+        cdemu.setOptions(index, options);
+        return;
+    }
+
+    const int deviceCount = cdemu.getDeviceCount();
+
+    for (int i = 0; i < deviceCount; ++i)
+        cdemu.setOptions(i, options);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static void releaseStaging(const QList<const CDEmu*>& endpoints)
+{
+    // Staged and extracted images may be mounted by any of the daemons
+    const QStringList loadedFiles = CDEmu::getLoadedFiles(endpoints);
+
+    RamStaging::release(loadedFiles);
+    ArchiveExtractor::release(loadedFiles);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto chooseArchiveImage(const QString& archive, const MountOptions& options) -> QString
+{
+    const QStringList images = ArchiveExtractor::images(archive);
+
+    if (images.isEmpty())
+        throw Exception(Error::ImageNotInArchive);
+
+    if (images.size() == 1)
+        return images.first();
+
+    if (options.chooseImage)
+    {
+        bool ok = false;
+
+        const QString label = i18n("Images in %1:", QFileInfo(archive).fileName());
+        const QString image = QInputDialog::getItem(nullptr, i18n("Select an image"), label, images,
+                                                    0, false, &ok);
+
+        return ok ? image : QString();
+    }
+
+    QTextStream out(stdout, QIODevice::WriteOnly);
+    out << "Images in " << archive << ":" << Qt::endl;
+
+    for (const QString& image : images)
+        out << "  " << image << Qt::endl;
+
+    throw Exception(Error::AmbiguousArchive);
+}
 
 // ---------------------------------------------------------------------------------------------- //
 
-static void mountImage(const CDEmu& cdemu, const QString& filename)
+static auto mountArchiveImage(const QList<const CDEmu*>& endpoints, const QString& filename,
+                              const MountOptions& options) -> MountedDevice
 {
+    const QString archive = ArchiveExtractor::archivePath(filename);
+    QString entry = ArchiveExtractor::entryPath(filename);
+
+    if (entry.isEmpty())
+        entry = chooseArchiveImage(archive, options);
+
+    // Cancelled by the user
+    if (entry.isEmpty())
+        return { nullptr, -1 };
+
+    const QString path = ArchiveExtractor::join(archive, entry);
+
+    // Extracting the same image again would only take up another device and more space
+    for (const CDEmu* endpoint : endpoints)
+    {
+        if (options.forceNew || !endpoint->isDaemonRunning())
+            continue;
+
+        const QList<CDEmu::Status> statuses = endpoint->getStatuses();
+
+        for (int i = 0; i < statuses.size(); ++i)
+        {
+            const CDEmu::Status& status = statuses.at(i);
+
+            if (!status.loaded || ArchiveExtractor::originalPath(status.fileName) != path)
+                continue;
+
+            QTextStream out(stdout, QIODevice::WriteOnly);
+            out << "Reusing device " << i;
+
+            if (endpoints.size() > 1)
+                out << " on daemon " << endpoints.indexOf(endpoint) + 1;
+
+            out << ", " << path << " is already mounted there" << Qt::endl;
+
+            return { endpoint, i };
+        }
+    }
+
+    // Make room first by dropping images that aren't mounted anymore
+    releaseStaging(endpoints);
+
+    const QString extractedFile = ArchiveExtractor::extract(path);
+
+    try {
+        // Checksum files next to the image are extracted along with it
+        if (ImageVerifier::isRequired())
+        {
+            const ImageVerifier::Report report = ImageVerifier::verify(extractedFile);
+
+            if (report.result == ImageVerifier::Result::Mismatch)
+                throw Exception(Error::ChecksumMismatch);
+
+            if (report.result != ImageVerifier::Result::Verified)
+                throw Exception(Error::ImageNotVerified);
+        }
+
+        const CDEmu& cdemu = *CDEmu::mostAvailable(endpoints);
+
+        int index = cdemu.getNextFreeDevice();
+
+        if (index < 0)
+            index = cdemu.addDevice();
+
+        DeviceProfile::apply(cdemu, index, options.profile);
+
+        if (!options.deviceOptions.isEmpty())
+            cdemu.setOptions(index, options.deviceOptions);
+
+        cdemu.mount(extractedFile, index);
+        ArchiveExtractor::commit(extractedFile);
+
+        if (cdemu.address().isEmpty())
+            MountJournal::recordMount(index, extractedFile);
+
+        QTextStream out(stdout, QIODevice::WriteOnly);
+        out << "Extracted " << entry << " from " << archive << " to device " << index << Qt::endl;
+
+        return { &cdemu, index };
+    }
+    catch (const Exception&) {
+        ArchiveExtractor::discard(extractedFile);
+        throw;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto findStagedImage(const CDEmu& cdemu, const QString& image) -> int
+{
+    const QList<CDEmu::Status> statuses = cdemu.getStatuses();
+
+    for (int i = 0; i < statuses.size(); ++i)
+    {
+        const QString& filename = statuses.at(i).fileName;
+
+        if (RamStaging::isStaged(filename) && RamStaging::originalPath(filename) == image)
+            return i;
+    }
+
+    return -1;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto mountImage(const QList<const CDEmu*>& endpoints, const QString& filename,
+                       const MountOptions& options) -> MountedDevice
+{
+    const QString path = QDir().absoluteFilePath(filename);
+
+    if (ArchiveExtractor::isArchiveImage(path))
+        return mountArchiveImage(endpoints, path, options);
+
+    const QString image = ImageCache::resolve(path);
+
+    // Loading the same image again would only take up another device
+    for (const CDEmu* endpoint : endpoints)
+    {
+        if (options.forceNew || !endpoint->isDaemonRunning())
+            continue;
+
+        // Only a device that reads the image the same way, from memory or from disk, will do
+        const int loaded = options.ram ? findStagedImage(*endpoint, image)
+                                       : endpoint->findImage(image);
+
+        if (loaded < 0)
+            continue;
+
+        QTextStream out(stdout, QIODevice::WriteOnly);
+        out << "Reusing device " << loaded;
+
+        if (endpoints.size() > 1)
+            out << " on daemon " << endpoints.indexOf(endpoint) + 1;
+
+        out << ", " << filename << " is already mounted there" << (options.ram ? " from RAM" : "")
+            << Qt::endl;
+        return { endpoint, loaded };
+    }
+
+    if (ImageVerifier::isRequired())
+    {
+        const ImageVerifier::Report report = ImageVerifier::verify(path);
+
+        if (report.result == ImageVerifier::Result::Mismatch)
+            throw Exception(Error::ChecksumMismatch);
+
+        if (report.result != ImageVerifier::Result::Verified)
+            throw Exception(Error::ImageNotVerified);
+    }
+
+    // Expand in a separate process so that the next mount can use the cache
+    if (image == path && ImageCache::isEnabled() && ImageCache::isCacheable(path))
+    {
+        // That process doesn't know which expanded images are mounted, so room is made here
+        ImageCache::release(CDEmu::getLoadedFiles(endpoints));
+
+        QProcess::startDetached(QCoreApplication::applicationFilePath(), { "--cache-image", path });
+    }
+
+    // Several images are spread across the daemons by their number of free devices
+    const CDEmu& cdemu = *CDEmu::mostAvailable(endpoints);
+
     int index = cdemu.getNextFreeDevice();
 
     if (index < 0)
         index = cdemu.addDevice();
 
-    cdemu.mount(QDir().absoluteFilePath(filename), index);
+    DeviceProfile::apply(cdemu, index, options.profile);
+
+    if (!options.deviceOptions.isEmpty())
+        cdemu.setOptions(index, options.deviceOptions);
+
+    if (!options.ram)
+    {
+        cdemu.mount(image, index);
+
+        // The journal only covers the session daemon
+        if (cdemu.address().isEmpty())
+            MountJournal::recordMount(index, image);
+
+        if (ImageWarmer::isEnabled())
+        {
+            QTextStream out(stdout, QIODevice::WriteOnly);
+            out << "Warmed up " << ImageWarmer::warmUp(image) << " bytes" << Qt::endl;
+        }
+
+        if (HotSet::isEnabled())
+        {
+            QTextStream out(stdout, QIODevice::WriteOnly);
+            out << "Prefetched " << HotSet::prefetch(image) << " bytes of the hot set" << Qt::endl;
+        }
+
+        return { &cdemu, index };
+    }
+
+    // Make room first by dropping copies of images that aren't mounted anymore
+    releaseStaging(endpoints);
+
+    const QString stagedFile = RamStaging::stage(image);
+
+    try {
+        cdemu.mount(stagedFile, index);
+        RamStaging::commit(stagedFile);
+
+        if (cdemu.address().isEmpty())
+            MountJournal::recordMount(index, stagedFile);
+    }
+    catch (const Exception&) {
+        RamStaging::discard(stagedFile);
+        throw;
+    }
+
+    return { &cdemu, index };
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-static void unmountImage(const CDEmu& cdemu, int index)
+static auto mountDiscSet(const QList<const CDEmu*>& endpoints, const QString& name,
+                         const QStringList& filenames, const MountOptions& options) -> MountedDevice
+{
+    QStringList images;
+
+    for (const QString& filename : filenames)
+    {
+        const QString path = QDir().absoluteFilePath(filename);
+
+        // Checked once here, swapping discs later doesn't look at the files again
+        if (!QFile::exists(path))
+            throw Exception(Error::FileNotFound);
+
+        images << path;
+    }
+
+    // The whole set is bound to one drive
+    const CDEmu& cdemu = *CDEmu::mostAvailable(endpoints);
+
+    int index = cdemu.getNextFreeDevice();
+
+    if (index < 0)
+        index = cdemu.addDevice();
+
+    DeviceProfile::apply(cdemu, index, options.profile);
+
+    if (!options.deviceOptions.isEmpty())
+        cdemu.setOptions(index, options.deviceOptions);
+
+    DiscSet set(name, images);
+    set.insert(cdemu, index, 0);
+
+    QTextStream out(stdout, QIODevice::WriteOnly);
+    out << "Disc set " << name << " with " << images.size() << " discs bound to device " << index
+        << Qt::endl;
+
+    return { &cdemu, index };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto insertNextDisc(const QList<const CDEmu*>& endpoints,
+                           const QString& name) -> MountedDevice
+{
+    DiscSet set = DiscSet::load(name);
+    const qint64 gap = set.next(endpoints);
+
+    QTextStream out(stdout, QIODevice::WriteOnly);
+    out << "Disc " << set.current() + 1 << "/" << set.images().size() << " ("
+        << QFileInfo(set.images().at(set.current())).fileName() << ") on device " << set.device()
+        << ", swapped in " << gap << " ms" << Qt::endl;
+
+    return { &set.endpoint(endpoints), set.device() };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static void waitForDevice(const MountedDevice& device, bool loaded, int timeout,
+                          const QElapsedTimer& timer)
+{
+    // The daemon answers before the kernel has noticed the change
+    DeviceWaiter waiter(*device.cdemu, device.index, loaded);
+
+    if (!waiter.wait(qMax<qint64>(0, timeout - timer.elapsed())))
+        throw Exception(Error::WaitTimedOut);
+
+    QTextStream out(stdout, QIODevice::WriteOnly);
+    out << "Device " << device.index << " ready after " << timer.elapsed() << " ms" << Qt::endl;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static void unmountImage(const QList<const CDEmu*>& endpoints, const CDEmu& cdemu, int index)
 {
     cdemu.unmount(index);
+
+    if (cdemu.address().isEmpty())
+        MountJournal::recordUnmount(index);
+
+    if (RamStaging::hasStagedImages() || ArchiveExtractor::hasExtractedImages())
+        releaseStaging(endpoints);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-static void printStatus(const CDEmu& cdemu)
+static void printStatus(const CDEmu& cdemu, bool rates)
 {
     static constexpr const char* Tab = "\t\t";
 
-    QTextStream out(stdout, QIODevice::WriteOnly);
-    out << "Device" << Tab << "Loaded" << Tab << "Image" << Qt::endl;
+    static constexpr int SampleTime = 250; // ms
 
     const int deviceCount = cdemu.getDeviceCount();
 
+    QStringList nodes;
+    QList<IoMonitor::Sample> samples;
+
+    bool busy = false;
+
+    for (int i = 0; i < deviceCount; ++i)
+    {
+        nodes << cdemu.getMapping(i).scsiCdRom;
+        samples << IoMonitor::sample(nodes.last());
+
+        busy = busy || samples.last().inFlight > 0;
+    }
+
+    // Rates are measured over a short interval, which is only worth waiting for if asked for or
+    // if a drive is being read from right now
+    const bool measured = rates || busy;
+
+    if (measured)
+        QThread::msleep(SampleTime);
+
+    QTextStream out(stdout, QIODevice::WriteOnly);
+    out << "Device" << Tab << "Loaded" << Tab << "Image" << Tab
+        << "Node" << Tab << "Reads/s" << Tab << "KiB/s" << Tab << "In flight" << Qt::endl;
+
     for (int i = 0; i < deviceCount; ++i)
     {
         CDEmu::Status status = cdemu.getStatus(i);
 
-        if (status.loaded)
+        if (status.loaded && RamStaging::isStaged(status.fileName))
+            out << i << Tab << "Yes" << Tab << RamStaging::originalPath(status.fileName)
+                << " (RAM)";
+        else if (status.loaded && ArchiveExtractor::isExtracted(status.fileName))
+            out << i << Tab << "Yes" << Tab << ArchiveExtractor::originalPath(status.fileName);
+        else if (status.loaded)
             out << i << Tab << "Yes" << Tab << status.fileName;
         else
             out << i << Tab << "No"  << Tab << "None";
 
+        out << Tab << (nodes.at(i).isEmpty() ? "None" : nodes.at(i));
+
+        if (measured)
+        {
+            const IoMonitor::Statistics statistics =
+                    IoMonitor::compare(samples.at(i), IoMonitor::sample(nodes.at(i)));
+
+            out << Tab << qRound(statistics.readsPerSecond)
+                << Tab << qRound(statistics.bytesPerSecond / 1024)
+                << Tab << statistics.inFlight;
+        }
+        else
+            out << Tab << "-" << Tab << "-" << Tab << samples.at(i).inFlight;
+
         out << Qt::endl;
     }
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
+static void benchmarkDrive(const CDEmu& cdemu, int index,
+                           const DriveBenchmark::Parameters& parameters)
+{
+    if (index < 0 || index >= cdemu.getDeviceCount())
+        throw Exception(Error::DeviceNotAvailable);
+
+    const QString node = cdemu.getMapping(index).scsiCdRom;
+
+    if (node.isEmpty())
+        throw Exception(Error::DeviceNotAvailable);
+
+    // Reading the image file directly as well shows how much the emulation costs
+    QStringList targets = { node };
+
+    const CDEmu::Status status = cdemu.getStatus(index);
+
+    if (status.loaded)
+        targets << ImageFile::dataFile(status.fileName);
+
+    QTextStream out(stdout, QIODevice::WriteOnly);
+    out << DriveBenchmark::run(targets, parameters) << Qt::endl;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto residentMemory() -> qint64
+{
+    QFile file("/proc/self/statm");
+
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+
+    const QList<QByteArray> fields = file.readAll().split(' ');
+
+    return fields.value(1).toLongLong() * sysconf(_SC_PAGESIZE);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static void processEventsFor(int duration)
+{
+    QEventLoop loop;
+    QTimer::singleShot(duration, &loop, &QEventLoop::quit);
+    loop.exec();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto watchImages(const QList<const CDEmu*>& endpoints, const QString& path) -> int
+{
+    WatchFolder watchFolder(endpoints);
+
+    if (!watchFolder.start(path))
+        throw Exception(Error::FolderNotWatchable);
+
+    // One line per event, so a harness can follow along
+    QObject::connect(&watchFolder, &WatchFolder::imageMounted,
+                     [](const QString& filename, int index, int latency) {
+        QTextStream out(stdout, QIODevice::WriteOnly);
+        out << "mounted\t" << index << "\t" << latency << " ms\t" << filename << Qt::endl;
+    });
+
+    QObject::connect(&watchFolder, &WatchFolder::imageReleased,
+                     [](const QString& filename, int index) {
+        QTextStream out(stdout, QIODevice::WriteOnly);
+        out << "released\t" << index << "\t" << filename << Qt::endl;
+    });
+
+    QObject::connect(&watchFolder, &WatchFolder::mountFailed,
+                     [](const QString& filename, const QString& reason) {
+        QTextStream err(stderr, QIODevice::WriteOnly);
+        err << "failed\t" << filename << "\t" << reason << Qt::endl;
+    });
+
+    // Losing the folder ends the session
+    QObject::connect(&watchFolder, &WatchFolder::statisticsChanged, [&watchFolder] {
+        if (!watchFolder.isRunning())
+            QCoreApplication::exit(-1);
+    });
+
+    return QCoreApplication::exec();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto runBatch(const CDEmu& cdemu, const QString& source) -> int
+{
+    BatchSession session(cdemu);
+
+    QObject::connect(&session, &BatchSession::finished, [](int failures) {
+        QCoreApplication::exit(failures > 0 ? 1 : 0);
+    });
+
+    if (!session.start(source))
+        throw Exception(Error::FileNotReadable);
+
+    return QCoreApplication::exec();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto replayTraffic(const QString& filename, double speed) -> int
+{
+    TrafficReplay replay;
+    replay.load(filename);
+
+    const QString address = replay.start(speed);
+
+    QTextStream out(stdout, QIODevice::WriteOnly);
+    out << "Replaying " << replay.callCount() << " calls and " << replay.signalCount()
+        << " signals on " << address << Qt::endl;
+    out << "Connect with --bus " << address << ", stop with Ctrl+C" << Qt::endl;
+
+    // Calls are answered until the end, the signals only have a timeline of their own
+    QObject::connect(&replay, &TrafficReplay::signalsFinished, [] {
+        QTextStream out(stdout, QIODevice::WriteOnly);
+        out << "All signals have been replayed" << Qt::endl;
+    });
+
+    return QCoreApplication::exec();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static void measureFootprint(const QList<const CDEmu*>& endpoints)
+{
+    static constexpr const char* Tab = "\t\t";
+
+    static constexpr int SettleTime = 2000; // ms
+
+    // Nothing is mounted, restored or saved, another instance may be running
+    TrayIcon tray(endpoints, TrayIcon::Mode::Passive);
+
+    // Give the device list time to be revalidated
+    tray.showWindow();
+    processEventsFor(SettleTime);
+    const qint64 shown = residentMemory();
+
+    tray.window()->hide();
+    processEventsFor(SettleTime);
+    const qint64 hidden = residentMemory();
+
+    tray.releaseWindow();
+    processEventsFor(SettleTime);
+    const qint64 released = residentMemory();
+
+    // Reopening from the tray starts out with the saved device list
+    QElapsedTimer timer;
+    timer.start();
+
+    tray.showWindow();
+    QCoreApplication::processEvents();
+
+    const qint64 rebuildTime = timer.elapsed();
+
+    tray.releaseWindow();
+
+    QTextStream out(stdout, QIODevice::WriteOnly);
+    out << "Window" << Tab << "RSS (KiB)" << Qt::endl;
+    out << "Shown" << Tab << shown / 1024 << Qt::endl;
+    out << "Hidden" << Tab << hidden / 1024 << Qt::endl;
+    out << "Released" << Tab << released / 1024 << Qt::endl;
+    out << "Rebuilt in " << rebuildTime << " ms" << Qt::endl;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static void requestTraceDump()
+{
+    // Name registered by KDBusService for the running instance
+    static constexpr const char* ServiceName = "org.kde.kde_cdemu";
+
+    const QDBusReply<uint> pid = QDBusConnection::sessionBus().interface()->servicePid(ServiceName);
+
+    if (!pid.isValid() || !EventTrace::requestDump(pid.value()))
+        throw Exception(Error::InstanceNotRunning);
+
+    QTextStream out(stdout, QIODevice::WriteOnly);
+    out << "Writing trace to " << EventTrace::dumpPath() << Qt::endl;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static void verifyImage(const QString& filename)
+{
+    static constexpr const char* Tab = "\t\t";
+
+    const ImageVerifier::Report report = ImageVerifier::verify(QDir().absoluteFilePath(filename));
+
+    QTextStream out(stdout, QIODevice::WriteOnly);
+
+    for (auto it = report.checksums.cbegin(); it != report.checksums.cend(); ++it)
+        out << it.key() << Tab << it.value() << Qt::endl;
+
+    switch (report.result)
+    {
+    case ImageVerifier::Result::Verified:
+        out << "Verified" << (report.cached ? " (cached)" : "") << Qt::endl;
+        break;
+
+    case ImageVerifier::Result::Mismatch:
+        out << "Mismatch" << Tab << report.mismatches.join(", ") << Qt::endl;
+        throw Exception(Error::ChecksumMismatch);
+
+    default:
+        out << "No checksum file found" << Qt::endl;
+        break;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 auto main(int argc, char* argv[]) -> int
 {
+    // Recorded on every start, --profile-startup only prints them
+    const int applicationPhase = StartupProfile::begin("QApplication");
     QApplication app(argc, argv);
-    app.setWindowIcon(QIcon::fromTheme("media-optical"));
+    StartupProfile::end(applicationPhase);
 
-    KLocalizedString::setApplicationDomain("kde_cdemu");
+    {
+        const StartupProfile::Phase phase("window icon");
+        app.setWindowIcon(QIcon::fromTheme("media-optical"));
+    }
+
+    {
+        const StartupProfile::Phase phase("setApplicationDomain");
+        KLocalizedString::setApplicationDomain("kde_cdemu");
+    }
+
+    const int aboutPhase = StartupProfile::begin("KAboutData");
 
     KAboutData aboutData(QStringLiteral("kde_cdemu"), i18n("KDE CDEmu Manager"),
                          QStringLiteral(KDE_CDEMU_VERSION), i18n("A KDE Frontend to CDEmu."),
@@ -97,40 +777,356 @@ auto main(int argc, char* argv[]) -> int
     app.setApplicationDisplayName(aboutData.displayName());
     app.setApplicationVersion(aboutData.version());
 
+    StartupProfile::end(aboutPhase);
+
     QCommandLineParser parser;
 
     aboutData.setupCommandLine(&parser);
 
     parser.setApplicationDescription(aboutData.shortDescription());
 
-    QCommandLineOption mountOption("mount", i18n("Mount an image."), i18n("file"));
+    QCommandLineOption busOption("bus", i18n("Connect to the CDEmu daemon on the given bus, which "
+                                             "can be \"session\", \"system\" or a D-Bus address. "
+                                             "Can be given multiple times, see --daemon."),
+                                 i18n("address"));
+    parser.addOption(busOption);
+
+    QCommandLineOption daemonOption("daemon", i18n("Daemon that device numbers refer to, counted "
+                                                   "in the order of --bus as shown by --status."),
+                                    i18n("number"), "1");
+    parser.addOption(daemonOption);
+
+    QCommandLineOption mountOption("mount", i18n("Mount an image, or one inside an archive as "
+                                                 "archive.zip:path/image.cue. Can be given "
+                                                 "multiple times."),
+                                   i18n("file"));
     parser.addOption(mountOption);
 
+    QCommandLineOption ramOption("ram", i18n("Copy the image into memory before mounting it."));
+    parser.addOption(ramOption);
+
+    QCommandLineOption chooseImageOption("choose-image", i18n("Ask which image to mount if an "
+                                                              "archive given with --mount "
+                                                              "contains several."));
+    parser.addOption(chooseImageOption);
+
+    QCommandLineOption forceNewOption("force-new", i18n("Mount on a new device even if the image "
+                                                        "is already mounted."));
+    parser.addOption(forceNewOption);
+
+    QCommandLineOption discSetOption("disc-set", i18n("Bind the images given with --mount to one "
+                                                      "device as a disc set, starting with the "
+                                                      "first."),
+                                     i18n("name"));
+    parser.addOption(discSetOption);
+
+    QCommandLineOption nextDiscOption("next-disc", i18n("Swap in the next disc of a disc set."),
+                                      i18n("name"));
+    parser.addOption(nextDiscOption);
+
+    QCommandLineOption profileOption("profile",
+                                     i18n("Apply the given device profile when mounting."),
+                                     i18n("name"), DeviceProfile::activeProfile());
+    parser.addOption(profileOption);
+
+    QCommandLineOption optionOption("option", i18n("Set a device option, e.g. tr-emulation=off."),
+                                    i18n("key=value"));
+    parser.addOption(optionOption);
+
+    QCommandLineOption deviceOption("device", i18n("Device to apply options to (default: all)."),
+                                    i18n("device number"), "-1");
+    parser.addOption(deviceOption);
+
     QCommandLineOption unmountOption("unmount", i18n("Unmount an image."), i18n("device number"));
     parser.addOption(unmountOption);
 
+    QCommandLineOption waitOption("wait", i18n("After --mount, --next-disc or --unmount, wait "
+                                               "until the drive reports the change."));
+    parser.addOption(waitOption);
+
+    QCommandLineOption waitTimeoutOption("wait-timeout", i18n("Maximum time to --wait."),
+                                         i18n("seconds"), "30");
+    parser.addOption(waitTimeoutOption);
+
     QCommandLineOption statusOption("status", i18n("Show information about devices."));
     parser.addOption(statusOption);
 
+    QCommandLineOption ratesOption("rates", i18n("Measure the read rates shown by --status even "
+                                                 "if no drive is busy."));
+    parser.addOption(ratesOption);
+
+    const DriveBenchmark::Parameters benchmarkDefaults = DriveBenchmark::defaultParameters();
+
+    QCommandLineOption benchOption("bench", i18n("Benchmark the read performance of a device."),
+                                   i18n("device number"));
+    parser.addOption(benchOption);
+
+    QCommandLineOption blockSizeOption("block-size", i18n("Block size used by --bench."),
+                                       i18n("bytes"), QString::number(benchmarkDefaults.blockSize));
+    parser.addOption(blockSizeOption);
+
+    QCommandLineOption queueDepthOption("queue-depth", i18n("Concurrent reads used by --bench."),
+                                        i18n("count"),
+                                        QString::number(benchmarkDefaults.queueDepth));
+    parser.addOption(queueDepthOption);
+
+    QCommandLineOption durationOption("duration", i18n("Duration of each --bench test."),
+                                      i18n("seconds"),
+                                      QString::number(benchmarkDefaults.duration / 1000));
+    parser.addOption(durationOption);
+
+    QCommandLineOption verifyOption("verify", i18n("Verify an image against its checksum files."),
+                                    i18n("file"));
+    parser.addOption(verifyOption);
+
+    QCommandLineOption cacheOption("cache-image", i18n("Decompress an image into the image cache."),
+                                   i18n("file"));
+    parser.addOption(cacheOption);
+
+    QCommandLineOption dumpTraceOption("dump-trace", i18n("Make the running instance write its "
+                                                          "event trace in Chrome trace format."));
+    parser.addOption(dumpTraceOption);
+
+    QCommandLineOption footprintOption("footprint", i18n("Measure the memory used with the "
+                                                         "window shown, hidden and released to "
+                                                         "the tray."));
+    parser.addOption(footprintOption);
+
+    QCommandLineOption watchOption("watch", i18n("Mount images as they appear in a folder and "
+                                                 "release them when they're removed."),
+                                   i18n("folder"));
+    parser.addOption(watchOption);
+
+    QCommandLineOption batchOption("batch", i18n("Run mount, unmount, status, devices and wait "
+                                                 "commands line by line over one connection, "
+                                                 "printing a JSON result for each. Use - to read "
+                                                 "from standard input."),
+                                   i18n("file"));
+    parser.addOption(batchOption);
+
+    QCommandLineOption profileStartupOption("profile-startup", i18n("Print how long each phase of "
+                                                                    "the startup took once the "
+                                                                    "window is shown, then quit."));
+    parser.addOption(profileStartupOption);
+
+    QCommandLineOption startupRunsOption("profile-startup-runs", i18n("Compare the given number of "
+                                                                      "cold starts with "
+                                                                      "--profile-startup."),
+                                         i18n("count"));
+    parser.addOption(startupRunsOption);
+
+    QCommandLineOption recordOption("record", i18n("Record all calls to the daemon and its "
+                                                   "signals, including timing and replies."),
+                                    i18n("file"));
+    parser.addOption(recordOption);
+
+    QCommandLineOption replayOption("replay", i18n("Serve recorded daemon traffic on a private bus "
+                                                   "that can be used with --bus."),
+                                    i18n("file"));
+    parser.addOption(replayOption);
+
+    QCommandLineOption replaySpeedOption("replay-speed", i18n("Time scale of --replay, e.g. 2 to "
+                                                              "replay twice as fast."),
+                                         i18n("factor"), "1");
+    parser.addOption(replaySpeedOption);
+
+    const int parserPhase = StartupProfile::begin("command line");
+
     parser.process(app);
     aboutData.processCommandLine(&parser);
 
+    StartupProfile::end(parserPhase);
+
     try {
-        CDEmu cdemu;
+        // These don't need the daemon
+        if (parser.isSet(verifyOption))
+        {
+            verifyImage(parser.value(verifyOption));
+            return 0;
+        }
+
+        if (parser.isSet(cacheOption))
+        {
+            ImageCache::expand(QDir().absoluteFilePath(parser.value(cacheOption)));
+            return 0;
+        }
+
+        if (parser.isSet(dumpTraceOption))
+        {
+            requestTraceDump();
+            return 0;
+        }
+
+        if (parser.isSet(startupRunsOption))
+        {
+            // The daemons to start against, e.g. a test daemon on a private bus
+            QStringList arguments;
+
+            for (const QString& address : parser.values(busOption))
+                arguments << "--bus" << address;
+
+            return StartupProfile::benchmark(arguments, parser.value(startupRunsOption).toInt());
+        }
+
+        if (parser.isSet(replayOption))
+        {
+            const double speed = parser.value(replaySpeedOption).toDouble();
+
+            if (speed <= 0)
+                throw Exception(Error::InvalidCommand);
+
+            return replayTraffic(parser.value(replayOption), speed);
+        }
+
+        // Before connecting, so the first calls are part of it
+        if (parser.isSet(recordOption) && !TrafficRecorder::start(parser.value(recordOption)))
+            throw Exception(Error::RecordingFailed);
+
+        QStringList addresses = parser.values(busOption);
+
+        if (addresses.isEmpty())
+            addresses << QString();
+
+        // Each daemon gets a connection of its own
+        std::vector<std::unique_ptr<CDEmu>> daemons;
+        QList<const CDEmu*> endpoints;
+
+        for (const QString& address : addresses)
+        {
+            // Includes starting the daemon if it isn't running yet
+            const StartupProfile::Phase phase("CDEmu");
+
+            daemons.push_back(std::make_unique<CDEmu>(address));
+            endpoints << daemons.back().get();
+        }
+
+        // Mounts are spread over all daemons, everything else that takes a device number
+        // addresses the selected one
+        const int daemon = parser.value(daemonOption).toInt();
+
+        if (daemon < 1 || daemon > endpoints.size())
+            throw Exception(Error::DaemonNotAvailable);
+
+        const CDEmu& cdemu = *endpoints.at(daemon - 1);
+
+        // Also the reference for --wait
+        QElapsedTimer timer;
+        timer.start();
+
+        const int waitTimeout = parser.value(waitTimeoutOption).toInt() * 1000;
 
         if (parser.isSet(mountOption))
-            mountImage(cdemu, parser.value(mountOption));
+        {
+            MountOptions options;
+            options.ram = parser.isSet(ramOption);
+            options.forceNew = parser.isSet(forceNewOption);
+            options.chooseImage = parser.isSet(chooseImageOption);
+            options.profile = parser.value(profileOption);
+            options.deviceOptions = parseDeviceOptions(parser.values(optionOption));
+
+            QList<MountedDevice> devices;
+
+            if (parser.isSet(discSetOption))
+            {
+                devices << mountDiscSet(endpoints, parser.value(discSetOption),
+                                        parser.values(mountOption), options);
+            }
+            else
+            {
+                for (const QString& filename : parser.values(mountOption))
+                {
+                    const MountedDevice device = mountImage(endpoints, filename, options);
+
+                    // Nothing is mounted if choosing an image from an archive was cancelled
+                    if (device.cdemu)
+                        devices << device;
+                }
+            }
+
+            // All images are loaded first, so the drives become ready in parallel
+            if (parser.isSet(waitOption))
+            {
+                for (const MountedDevice& device : devices)
+                    waitForDevice(device, true, waitTimeout, timer);
+            }
+        }
+        else if (parser.isSet(nextDiscOption))
+        {
+            const MountedDevice device = insertNextDisc(endpoints, parser.value(nextDiscOption));
+
+            if (parser.isSet(waitOption))
+                waitForDevice(device, true, waitTimeout, timer);
+        }
+        else if (parser.isSet(optionOption))
+        {
+            const QVariantMap options = parseDeviceOptions(parser.values(optionOption));
+            setDeviceOptions(cdemu, parser.value(deviceOption).toInt(), options);
+        }
         else if (parser.isSet(unmountOption))
-            unmountImage(cdemu, parser.value(unmountOption).toInt());
+        {
+            const int index = parser.value(unmountOption).toInt();
+            unmountImage(endpoints, cdemu, index);
+
+            if (parser.isSet(waitOption))
+                waitForDevice({ &cdemu, index }, false, waitTimeout, timer);
+        }
         else if (parser.isSet(statusOption))
-            printStatus(cdemu);
+        {
+            for (const CDEmu* endpoint : endpoints)
+            {
+                if (endpoints.size() > 1)
+                {
+                    QTextStream out(stdout, QIODevice::WriteOnly);
+                    const QString bus = endpoint->address().isEmpty() ? QString("session")
+                                                                      : endpoint->address();
+
+                    out << "Daemon " << endpoints.indexOf(endpoint) + 1 << ", bus: " << bus
+                        << Qt::endl;
+                }
+
+                printStatus(*endpoint, parser.isSet(ratesOption));
+            }
+        }
+        else if (parser.isSet(benchOption))
+        {
+            const DriveBenchmark::Parameters parameters = {
+                parser.value(blockSizeOption).toInt(),
+                parser.value(queueDepthOption).toInt(),
+                parser.value(durationOption).toInt() * 1000
+            };
+
+            benchmarkDrive(cdemu, parser.value(benchOption).toInt(), parameters);
+        }
+        else if (parser.isSet(footprintOption))
+            measureFootprint(endpoints);
+        else if (parser.isSet(batchOption))
+            return runBatch(cdemu, parser.value(batchOption));
+        else if (parser.isSet(watchOption))
+            return watchImages(endpoints, parser.value(watchOption));
         else
         {
-            // Allow only one application instance
-            const KDBusService service(KDBusService::Unique);
+            const bool profileStartup = parser.isSet(profileStartupOption);
+
+            // Allow only one application instance, unless only the startup is measured
+            const int servicePhase = StartupProfile::begin("KDBusService");
+            const KDBusService service(profileStartup ? KDBusService::Multiple
+                                                      : KDBusService::Unique);
+            StartupProfile::end(servicePhase);
+
+            // Allows dumping the event trace with a signal, e.g. "--dump-trace"
+            EventTrace::installSignalHandler();
+
+            // Quitting is up to the window, which knows whether the tray icon is shown
+            app.setQuitOnLastWindowClosed(false);
+
+            const int trayPhase = StartupProfile::begin("TrayIcon");
+            TrayIcon tray(endpoints);
+            StartupProfile::end(trayPhase);
+
+            tray.showWindow();
 
-            MainWindow window(cdemu);
-            window.show();
+            if (profileStartup)
+                StartupProfile::quitAfterFirstFrame(tray.window());
 
             return QApplication::exec();
         }
@@ -19,16 +19,41 @@
  *                                                                          *
  ****************************************************************************/
 
+#include "archiveextractor.h"
 #include "devicelistitem.h"
+#include "deviceoptionsdialog.h"
+#include "deviceprofile.h"
+#include "discset.h"
+#include "drivebenchmark.h"
+#include "eventtrace.h"
+#include "hotset.h"
+#include "imagecache.h"
+#include "imagefile.h"
+#include "imagewarmer.h"
 #include "mainwindow.h"
 #include "messagebox.h"
+#include "mountjournal.h"
+#include "ramstaging.h"
+#include "startupprofile.h"
+#include "trayicon.h"
+#include "watchfolder.h"
 
 #include "ui_mainwindow.h"
 
 #include <KStandardAction>
 
+#include <QCollator>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QFileDialog>
 #include <QHeaderView>
+#include <QInputDialog>
+#include <QLocale>
+#include <QTimer>
+#include <QTreeWidgetItemIterator>
+
+#include <algorithm>
+#include <climits>
 
 // ---------------------------------------------------------------------------------------------- //
 
@@ -37,41 +62,113 @@ namespace {
                                               "*.bin *.toc *.cdi *.cif *.c2d *.iso *.nrg *.udf);;"
                                       "Containers (*.dmg *.cdr *.cso *.ecm *.gz "
                                                   "*.gbi *.daa *.isz *.xz)";
+    constexpr const char* ArchiveTypes = "Archives (*.zip *.7z *.tar *.tar.gz *.tgz *.tar.xz *.txz "
+                                                   "*.tar.zst *.tzst *.tar.bz2 *.tbz2)";
     constexpr int MaxHistorySize = 10;
 
     constexpr const char* HistoryKey = "history";
-    constexpr const char* ShowTrayIconKey = "showTrayIcon";
     constexpr const char* LastFilePathKey = "lastFilePath";
+    constexpr const char* DeviceSnapshotKey = "deviceSnapshot";
+
+    auto sourceFileName(const QString& filename) -> QString
+    {
+        // Maps RAM staged, cached and extracted copies back to the image the user selected
+        const QString original = ImageCache::originalPath(RamStaging::originalPath(filename));
+        return ArchiveExtractor::originalPath(original);
+    }
+
+    auto groupTitle(const CDEmu& cdemu) -> QString
+    {
+        if (cdemu.isDaemonRunning())
+            return cdemu.displayName();
+
+        return i18n("%1 (not running)", cdemu.displayName());
+    }
+
+    auto snapshotKey(const CDEmu& cdemu) -> QString
+    {
+        return cdemu.address().isEmpty() ? QString("session") : cdemu.address();
+    }
+
+    // For requests whose only result is an error, if any
+    void showError(const QDBusMessage& reply)
+    {
+        const QString error = CDEmu::errorOf(reply);
+
+        if (!error.isEmpty())
+            MessageBox::error(error);
+    }
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-MainWindow::MainWindow(const CDEmu& cdemu, QWidget* parent)
+MainWindow::MainWindow(const QList<const CDEmu*>& endpoints, TrayIcon& tray, QWidget* parent)
     : KMainWindow(parent),
       m_ui(std::make_unique<Ui::MainWindow>()),
-      m_cdemu(cdemu)
+      m_endpoints(endpoints),
+      m_tray(tray)
 {
-    // Keep running in system tray if enabled
-    setAttribute(Qt::WA_DeleteOnClose, false);
+    Q_ASSERT(!m_endpoints.isEmpty());
 
-    m_ui->setupUi(this);
+    {
+        const StartupProfile::Phase phase("setupUi");
+        m_ui->setupUi(this);
+    }
 
     // Menus
+    connect(m_ui->actionMountDiscSet, SIGNAL(triggered(bool)), this, SLOT(mountDiscSet()));
     m_ui->menuFile->addAction(KStandardAction::quit(qApp, SLOT(quit()), this));
 
-    updateHistory();
+    {
+        const StartupProfile::Phase phase("updateHistory");
+        updateHistory();
+    }
 
-    m_helpMenu = new KHelpMenu(this);
-    menuBar()->addMenu(m_helpMenu->menu());
+    {
+        const StartupProfile::Phase phase("KHelpMenu");
+
+        m_helpMenu = new KHelpMenu(this);
+        menuBar()->addMenu(m_helpMenu->menu());
+    }
 
     // Tray icon
-    QSettings settings;
+    m_ui->actionTrayIcon->setChecked(m_tray.isVisible());
+    connect(m_ui->actionTrayIcon, SIGNAL(toggled(bool)), this, SLOT(setTrayIconVisible(bool)));
 
-    const bool showTrayIcon = settings.value(ShowTrayIconKey, true).toBool();
-    setTrayIconVisible(showTrayIcon);
+    m_ui->actionLowFootprint->setChecked(TrayIcon::isLowFootprint());
+    connect(m_ui->actionLowFootprint, SIGNAL(toggled(bool)),
+            this,                     SLOT(setLowFootprintEnabled(bool)));
 
-    m_ui->actionTrayIcon->setChecked(showTrayIcon);
-    connect(m_ui->actionTrayIcon, SIGNAL(toggled(bool)), this, SLOT(setTrayIconVisible(bool)));
+    // Verification
+    m_ui->actionRequireVerified->setChecked(ImageVerifier::isRequired());
+    connect(m_ui->actionRequireVerified, SIGNAL(toggled(bool)),
+            this,                        SLOT(setRequireVerified(bool)));
+
+    // Image cache
+    m_ui->actionImageCache->setChecked(ImageCache::isEnabled());
+    connect(m_ui->actionImageCache, SIGNAL(toggled(bool)), this, SLOT(setImageCacheEnabled(bool)));
+    connect(m_ui->actionImageCacheSize, SIGNAL(triggered(bool)), this, SLOT(configureImageCache()));
+
+    // RAM staging
+    connect(m_ui->actionRamStagingLimit, SIGNAL(triggered(bool)),
+            this,                          SLOT(configureRamStaging()));
+
+    // Archives
+    connect(m_ui->actionArchiveScratchLimit, SIGNAL(triggered(bool)),
+            this,                            SLOT(configureArchiveScratch()));
+
+    // Warm-up
+    m_ui->actionWarmUp->setChecked(ImageWarmer::isEnabled());
+    connect(m_ui->actionWarmUp, SIGNAL(toggled(bool)), this, SLOT(setWarmUpEnabled(bool)));
+
+    // Hot sets
+    m_ui->actionHotSets->setChecked(HotSet::isEnabled());
+    connect(m_ui->actionHotSets, SIGNAL(toggled(bool)), this, SLOT(setHotSetsEnabled(bool)));
+
+    // Mount journal
+    m_ui->actionRestoreMounts->setChecked(MountJournal::isRestoreEnabled());
+    connect(m_ui->actionRestoreMounts, SIGNAL(toggled(bool)),
+            this,                      SLOT(setRestoreMountsEnabled(bool)));
 
     // Device list
     m_ui->deviceList->header()->setStretchLastSection(false);
@@ -82,122 +179,240 @@ MainWindow::MainWindow(const CDEmu& cdemu, QWidget* parent)
     const QString header = i18n(m_ui->deviceList->headerItem()->text(0).toLocal8Bit()) + "xxx";
     m_ui->deviceList->header()->resizeSection(0, QFontMetrics(font()).horizontalAdvance(header));
 
+    // Show the devices as they were last time until the daemons have answered
+    {
+        const StartupProfile::Phase phase("restoreSnapshot");
+        restoreSnapshot();
+    }
+
     // Device handling
     connect(m_ui->addDevice, SIGNAL(clicked()), this, SLOT(addDevice()));
     connect(m_ui->removeDevice, SIGNAL(clicked()), this, SLOT(removeDevice()));
 
-    connect(&m_cdemu, SIGNAL(deviceAdded()), this, SLOT(updateDeviceList()));
-    connect(&m_cdemu, SIGNAL(deviceRemoved()), this, SLOT(updateDeviceList()));
-    connect(&m_cdemu, SIGNAL(deviceChanged(int)), this, SLOT(onDeviceChanged(int)));
-    connect(&m_cdemu, SIGNAL(daemonChanged(bool)), this, SLOT(onDaemonChanged(bool)));
+    for (const CDEmu* cdemu : m_endpoints)
+    {
+        connect(cdemu, SIGNAL(deviceAdded()), this, SLOT(revalidateDeviceList()));
+        connect(cdemu, SIGNAL(deviceRemoved()), this, SLOT(revalidateDeviceList()));
+        connect(cdemu, SIGNAL(deviceChanged(int)), this, SLOT(onDeviceChanged(int)));
+        connect(cdemu, SIGNAL(daemonChanged(bool)), this, SLOT(onDaemonChanged(bool)));
+        connect(cdemu, SIGNAL(mappingsReady()), this, SLOT(updateDeviceNodes()));
+        connect(cdemu, SIGNAL(mappingsUpdated()), this, SLOT(updateDeviceNodes()));
+    }
+
+    // Drive activity
+    connect(&m_ioMonitor, SIGNAL(updated()), this, SLOT(updateActivity()));
 
     // Status bar
     m_statusLabel = new QLabel(this);
     m_statusLabel->setIndent(10);
     statusBar()->addWidget(m_statusLabel);
-    onDaemonChanged(m_cdemu.isDaemonRunning());
+
+    // Stall detection
+    m_stallLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(m_stallLabel);
+
+    connect(&m_stallDetector, SIGNAL(stallDetected(QString,int)),
+            this,             SLOT(onStallDetected(QString,int)));
+
+    m_ui->actionDetectStalls->setChecked(StallDetector::isEnabled());
+    setStallDetectionEnabled(StallDetector::isEnabled());
+
+    connect(m_ui->actionDetectStalls, SIGNAL(toggled(bool)),
+            this,                     SLOT(setStallDetectionEnabled(bool)));
+    connect(m_ui->actionStallThreshold, SIGNAL(triggered(bool)),
+            this,                       SLOT(configureStallThreshold()));
+
+    // Watch folder, which belongs to the tray icon so it outlives the window
+    m_watchLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(m_watchLabel);
+
+    const WatchFolder& watchFolder = m_tray.watchFolder();
+
+    connect(&watchFolder, SIGNAL(statisticsChanged()), this, SLOT(updateWatchStatus()));
+    connect(&watchFolder, SIGNAL(mountFailed(QString,QString)),
+            this,         SLOT(onWatchMountFailed(QString,QString)));
+
+    m_ui->actionWatchFolder->setChecked(watchFolder.isRunning());
+    updateWatchStatus();
+
+    connect(m_ui->actionWatchFolder, SIGNAL(toggled(bool)),
+            this,                    SLOT(setWatchFolderEnabled(bool)));
+
+    // Hot sets, which are sampled by the tray icon while the window is released
+    m_hotSetLabel = new QLabel(this);
+    m_hotSetLabel->hide();
+    statusBar()->addPermanentWidget(m_hotSetLabel);
+
+    connect(&m_tray, SIGNAL(hotSetLearned(QString,qint64,int,qint64)),
+            this,    SLOT(onHotSetLearned(QString,qint64,int,qint64)));
+
+    // Daemon operations
+    m_schedulerLabel = new QLabel(this);
+    m_schedulerLabel->hide();
+    statusBar()->addPermanentWidget(m_schedulerLabel);
+
+    for (const CDEmu* cdemu : m_endpoints)
+    {
+        connect(&cdemu->scheduler(), SIGNAL(statisticsChanged()),
+                this,                SLOT(updateSchedulerStatus()));
+    }
+
+    onDaemonChanged(m_endpoints.first()->isDaemonRunning());
 
     // Remember window size, etc.
-    setAutoSaveSettings();
+    const StartupProfile::Phase phase("setAutoSaveSettings");
+
+    if (!m_tray.isPassive())
+        setAutoSaveSettings();
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-MainWindow::~MainWindow() = default;
+MainWindow::~MainWindow()
+{
+    // Deleting the children below would report back to a window that's already half gone
+    for (QObject* worker : std::as_const(m_workers))
+        disconnect(worker, nullptr, this, nullptr);
+
+    if (!m_tray.isPassive())
+        saveSnapshot();
+}
 
 // ---------------------------------------------------------------------------------------------- //
 
 void MainWindow::closeEvent(QCloseEvent* event)
 {
+    // Keep running in system tray if enabled, optionally without the window. Workers report back
+    // to the window, so it's only freed once they're done, see addWorker().
+    setAttribute(Qt::WA_DeleteOnClose, TrayIcon::isLowFootprint() && m_workers.isEmpty());
+
     KMainWindow::closeEvent(event);
 
-    if (!m_trayIcon)
+    if (!m_tray.isVisible())
         qApp->quit();
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void MainWindow::onDaemonChanged(bool running)
+void MainWindow::showEvent(QShowEvent* event)
 {
-    Q_ASSERT(m_statusLabel != nullptr);
+    KMainWindow::showEvent(event);
+    m_ioMonitor.start();
+}
 
-    m_ui->centralWidget->setEnabled(running);
+// ---------------------------------------------------------------------------------------------- //
 
-    if (running)
-    {
-        updateDeviceList();
-        m_statusLabel->setText(i18n("CDEmu daemon is running."));
-    }
-    else
-        m_statusLabel->setText(i18n("CDEmu daemon not running."));
+void MainWindow::hideEvent(QHideEvent* event)
+{
+    KMainWindow::hideEvent(event);
+
+    // Nobody's looking, so don't even wake up
+    m_ioMonitor.stop();
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void MainWindow::onDeviceChanged(int index)
+auto MainWindow::groupItem(const CDEmu& cdemu) const -> QTreeWidgetItem*
 {
-    // CDEmu emits "DeviceStatusChanged" before "DeviceRemoved" if device was loaded
-    auto item = dynamic_cast<DeviceListItem*>(m_ui->deviceList->topLevelItem(index));
+    // The devices of a single daemon aren't grouped
+    if (m_endpoints.size() == 1)
+        return m_ui->deviceList->invisibleRootItem();
 
-    if (index < m_cdemu.getDeviceCount() && item)
-        item->setFileName(m_cdemu.getFileName(index));
+    return m_ui->deviceList->topLevelItem(m_endpoints.indexOf(&cdemu));
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void MainWindow::updateDeviceList()
+auto MainWindow::deviceItem(const CDEmu& cdemu, int index) const -> DeviceListItem*
 {
-    m_ui->deviceList->clear();
+    QTreeWidgetItem* group = groupItem(cdemu);
 
-    const int deviceCount = m_cdemu.getDeviceCount();
+    if (!group)
+        return nullptr;
 
-    for (int i = 0; i < deviceCount; ++i)
-    {
-        auto item = new DeviceListItem(i);
-        item->setFileName(m_cdemu.getFileName(i));
+    return dynamic_cast<DeviceListItem*>(group->child(index));
+}
+
+// ---------------------------------------------------------------------------------------------- //
 
-        connect(item, SIGNAL(mountClicked(int)), this, SLOT(mount(int)));
-        connect(item, SIGNAL(unmountClicked(int)), this, SLOT(unmount(int)));
+auto MainWindow::endpoint(QTreeWidgetItem* item) const -> const CDEmu&
+{
+    if (m_endpoints.size() > 1 && item)
+    {
+        QTreeWidgetItem* group = item->parent() ? item->parent() : item;
+        const int index = m_ui->deviceList->indexOfTopLevelItem(group);
 
-        m_ui->deviceList->addTopLevelItem(item);
-        m_ui->deviceList->setItemWidget(item, 0, new QLabel(QString("  %1").arg(i)));
-        m_ui->deviceList->setItemWidget(item, 1, item->widget());
+        if (index >= 0)
+            return *m_endpoints.at(index);
     }
 
-    m_ui->removeDevice->setEnabled(m_ui->deviceList->topLevelItemCount() > 0);
+    return *m_endpoints.first();
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void MainWindow::mount(int index)
+auto MainWindow::senderEndpoint() const -> const CDEmu&
 {
-    QSettings settings;
-    QString path = settings.value(LastFilePathKey, QDir::homePath()).toString();
+    return endpoint(qobject_cast<DeviceListItem*>(sender()));
+}
 
-    const QString filename =
-            QFileDialog::getOpenFileName(this, i18n("Select an image file"), path, FileTypes);
+// ---------------------------------------------------------------------------------------------- //
 
-    if (filename.isEmpty())
-        return;
+void MainWindow::onDaemonChanged(bool running)
+{
+    Q_ASSERT(m_statusLabel != nullptr);
 
-    path = QFileInfo(filename).path();
-    settings.setValue(LastFilePathKey, path);
+    const auto cdemu = qobject_cast<const CDEmu*>(sender());
 
-    try {
-        m_cdemu.mount(filename, index);
-        appendHistory(filename);
+    // Only the session daemon is journaled
+    if (cdemu && cdemu->address().isEmpty() && !m_tray.isPassive())
+    {
+        if (running && m_daemonLost && MountJournal::isRestoreEnabled())
+            restoreMounts(*cdemu);
+
+        m_daemonLost = !running;
     }
-    catch (const Exception& e) {
-        MessageBox::error(e.what());
+
+    int runningCount = 0;
+
+    for (const CDEmu* endpoint : m_endpoints)
+    {
+        if (endpoint->isDaemonRunning())
+            ++runningCount;
+    }
+
+    m_ui->centralWidget->setEnabled(runningCount > 0);
+
+    if (runningCount > 0)
+        revalidateDeviceList();
+
+    if (m_endpoints.size() > 1)
+    {
+        m_statusLabel->setText(i18n("%1 of %2 CDEmu daemons running.",
+                                    runningCount, m_endpoints.size()));
     }
+    else if (running)
+        m_statusLabel->setText(i18n("CDEmu daemon is running."));
+    else
+        m_statusLabel->setText(i18n("CDEmu daemon not running."));
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void MainWindow::unmount(int index)
+void MainWindow::restoreMounts(const CDEmu& cdemu)
 {
+    QElapsedTimer timer;
+    timer.start();
+
     try {
-        m_cdemu.unmount(index);
+        const int restored = MountJournal::restore(cdemu);
+
+        if (restored > 0)
+        {
+            statusBar()->showMessage(i18np("Restored 1 image in %2 ms",
+                                           "Restored %1 images in %2 ms",
+                                           restored, timer.elapsed()), 10000);
+        }
     }
     catch (const Exception& e) {
         MessageBox::error(e.what());
@@ -206,135 +421,1442 @@ void MainWindow::unmount(int index)
 
 // ---------------------------------------------------------------------------------------------- //
 
-void MainWindow::mountFromHistory()
+void MainWindow::onDeviceChanged(int index)
 {
-    const auto action = qobject_cast<QAction*>(sender());
-    Q_ASSERT(action != nullptr);
+    const auto cdemu = qobject_cast<const CDEmu*>(sender());
 
-    try {
-        const QString filename = action->data().toString();
-        const int index = m_cdemu.getNextFreeDevice();
+    if (!cdemu)
+        return;
 
-        m_cdemu.mount(filename, index);
-        appendHistory(filename);
-    }
-    catch (const Exception& e) {
-        MessageBox::error(e.what());
-    }
+    // Nothing here waits for the daemon. CDEmu emits "DeviceStatusChanged" before "DeviceRemoved"
+    // if device was loaded, so there may be no status to show.
+    cdemu->requestStatus(index, OperationScheduler::Interactive, this,
+                         [this, cdemu, index](const QDBusMessage& reply) {
+        if (reply.type() != QDBusMessage::ReplyMessage)
+            return;
+
+        const QString filename = CDEmu::toStatus(reply).fileName;
+
+        if (auto item = deviceItem(*cdemu, index))
+            setItemFileName(item, filename);
+
+        // Also catches changes made by other clients, but only the session daemon is journaled
+        if (cdemu->address().isEmpty() && !m_tray.isPassive())
+            MountJournal::recordState(index, filename);
+
+        // Posted repaints are handled before zero timers, so this is recorded once the view
+        // shows it
+        m_ui->deviceList->viewport()->update();
+
+        QTimer::singleShot(0, this, [index] {
+            EventTrace::instant("View updated", index);
+        });
+
+        if (m_tray.isPassive())
+            return;
+
+        // Free the memory and scratch space of images that have been unmounted
+        const bool staged = RamStaging::hasStagedImages();
+        const bool extracted = ArchiveExtractor::hasExtractedImages();
+
+        if (!staged && !extracted)
+            return;
+
+        const QStringList files = loadedFiles();
+
+        if (staged)
+            RamStaging::release(files);
+
+        if (extracted)
+            ArchiveExtractor::release(files);
+    });
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void MainWindow::clearHistory()
+void MainWindow::setItemFileName(DeviceListItem* item, const QString& filename)
 {
-    QSettings settings;
-    settings.setValue(HistoryKey, QStringList());
+    item->setFileName(sourceFileName(filename));
+    item->setLoadedFile(filename);
 
-    updateHistory();
+    if (RamStaging::isStaged(filename))
+    {
+        const QString size = QLocale().formattedDataSize(RamStaging::stagedSize(filename));
+        item->setStatusText(i18n("In RAM (%1)", size));
+    }
+    else
+        item->setStatusText(QString());
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void MainWindow::addDevice()
+auto MainWindow::loadedFiles() const -> QStringList
 {
-    try {
-        m_cdemu.addDevice();
-    }
-    catch (const Exception& e) {
-        MessageBox::error(e.what());
+    // Taken from the view, which is kept up to date, instead of asking every daemon again
+    QStringList files;
+
+    for (QTreeWidgetItemIterator it(m_ui->deviceList); *it; ++it)
+    {
+        const auto item = dynamic_cast<DeviceListItem*>(*it);
+
+        if (item && !item->loadedFile().isEmpty())
+            files << item->loadedFile();
     }
+
+    return files;
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void MainWindow::removeDevice()
+auto MainWindow::findLoadedImage(const CDEmu& cdemu, const QString& image) const -> int
 {
-    try {
-        m_cdemu.removeDevice();
+    // Like CDEmu::findImage(), but the view knows which files are loaded
+    const QString identity = ImageFile::identity(image);
+
+    if (identity.isEmpty())
+        return -1;
+
+    for (int i = 0; DeviceListItem* item = deviceItem(cdemu, i); ++i)
+    {
+        const QString filename = item->loadedFile();
+
+        if (!filename.isEmpty() && ImageFile::identity(filename) == identity)
+            return i;
     }
-    catch (const Exception& e) {
-        MessageBox::error(e.what());
+
+    return -1;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto MainWindow::findStagedImage(const CDEmu& cdemu, const QString& image) const -> int
+{
+    // The view knows which files are loaded
+    for (int i = 0; DeviceListItem* item = deviceItem(cdemu, i); ++i)
+    {
+        const QString filename = item->loadedFile();
+
+        if (RamStaging::isStaged(filename) && RamStaging::originalPath(filename) == image)
+            return i;
     }
+
+    return -1;
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void MainWindow::setTrayIconVisible(bool visible)
+void MainWindow::revalidateDeviceList()
 {
-    Q_ASSERT(m_helpMenu != nullptr);
+    const int generation = ++m_listGeneration;
 
-    if (visible)
+    for (const CDEmu* cdemu : m_endpoints)
     {
-        if (!m_trayIcon)
+        QTreeWidgetItem* group = groupItem(*cdemu);
+
+        if (!group)
+            continue;
+
+        if (m_endpoints.size() > 1)
+            group->setText(0, groupTitle(*cdemu));
+
+        if (!cdemu->isDaemonRunning())
         {
-            m_trayIcon = new KStatusNotifierItem(this);
-            m_trayIcon->setIconByName("media-optical");
-            m_trayIcon->setCategory(KStatusNotifierItem::ApplicationStatus);
-            m_trayIcon->setStatus(KStatusNotifierItem::Active);
-            m_trayIcon->setToolTip("media-optical", "KDE CDEmu Manager", "");
-            m_trayIcon->contextMenu()->addMenu(m_helpMenu->menu());
+            applyDeviceStatus(*cdemu, {});
+            continue;
         }
+
+        // Nothing blocks, the replies are applied as they come in
+        auto watcher = new QDBusPendingCallWatcher(cdemu->requestDeviceCount(), this);
+
+        connect(watcher, &QDBusPendingCallWatcher::finished, this,
+                [this, cdemu, generation](QDBusPendingCallWatcher* call) {
+            call->deleteLater();
+
+            if (generation != m_listGeneration)
+                return;
+
+            const QDBusPendingReply<int> reply = *call;
+            const int count = reply.isError() ? 0 : reply.value();
+
+            if (count == 0)
+            {
+                applyDeviceStatus(*cdemu, {});
+                return;
+            }
+
+            // All devices are asked at once, the list is updated when the last one has answered
+            auto statuses = std::make_shared<QList<CDEmu::Status>>(count);
+            auto pending = std::make_shared<int>(count);
+
+            for (int i = 0; i < count; ++i)
+            {
+                auto statusWatcher = new QDBusPendingCallWatcher(cdemu->requestStatus(i), this);
+
+                connect(statusWatcher, &QDBusPendingCallWatcher::finished, this,
+                        [this, cdemu, generation, statuses, pending, i](
+                                QDBusPendingCallWatcher* statusCall) {
+                    statusCall->deleteLater();
+
+                    (*statuses)[i] = CDEmu::toStatus(statusCall->reply());
+
+                    if (--*pending == 0 && generation == m_listGeneration)
+                        applyDeviceStatus(*cdemu, *statuses);
+                });
+            }
+        });
     }
-    else
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::applyDeviceStatus(const CDEmu& cdemu, const QList<CDEmu::Status>& statuses)
+{
+    QTreeWidgetItem* group = groupItem(cdemu);
+
+    if (!group)
+        return;
+
+    // Only differences are applied, so the list doesn't flash
+    while (group->childCount() > statuses.size())
+        delete group->takeChild(group->childCount() - 1);
+
+    for (int i = 0; i < statuses.size(); ++i)
     {
-        delete m_trayIcon;
-        m_trayIcon = nullptr;
+        auto item = deviceItem(cdemu, i);
+
+        if (!item)
+            item = addDeviceItem(group, i);
+
+        const QString& filename = statuses.at(i).fileName;
+        const bool stale = !item->widget()->isEnabled();
+
+        if (stale || item->loadedFile() != filename)
+            setItemFileName(item, filename);
+
+        item->widget()->setEnabled(true);
     }
 
-    QSettings settings;
-    settings.setValue(ShowTrayIconKey, visible);
+    group->setExpanded(true);
+
+    updateDeviceActions();
+    updateDeviceNodes();
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void MainWindow::appendHistory(const QString& filename)
+auto MainWindow::addGroupItem(const CDEmu& cdemu) -> QTreeWidgetItem*
 {
-    QSettings settings;
-    QStringList history = settings.value(HistoryKey).toStringList();
+    // The devices of a single daemon aren't grouped
+    if (m_endpoints.size() == 1)
+        return m_ui->deviceList->invisibleRootItem();
 
-    history.removeAll(filename);
-    history.prepend(filename);
+    auto group = new QTreeWidgetItem(m_ui->deviceList);
+    group->setFirstColumnSpanned(true);
+    group->setText(0, cdemu.displayName());
 
-    settings.setValue(HistoryKey, history);
+    return group;
+}
 
-    updateHistory();
+// ---------------------------------------------------------------------------------------------- //
+
+auto MainWindow::addDeviceItem(QTreeWidgetItem* group, int index) -> DeviceListItem*
+{
+    auto item = new DeviceListItem(index);
+
+    connect(item, SIGNAL(mountClicked(int)), this, SLOT(mount(int)));
+    connect(item, SIGNAL(mountToRamClicked(int)), this, SLOT(mountToRam(int)));
+    connect(item, SIGNAL(unmountClicked(int)), this, SLOT(unmount(int)));
+    connect(item, SIGNAL(verifyClicked(int)), this, SLOT(verify(int)));
+    connect(item, SIGNAL(benchmarkClicked(int)), this, SLOT(benchmark(int)));
+    connect(item, SIGNAL(optionsClicked(int)), this, SLOT(showDeviceOptions(int)));
+
+    group->addChild(item);
+    m_ui->deviceList->setItemWidget(item, 0, new QLabel(QString("  %1").arg(index)));
+    m_ui->deviceList->setItemWidget(item, 1, item->widget());
+
+    return item;
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void MainWindow::updateHistory()
+void MainWindow::updateDeviceActions()
 {
-    QSettings settings;
-    QStringList history = settings.value(HistoryKey).toStringList();
+    bool hasDevices = false;
 
-    // Delete invalid entries
-    QStringList::iterator it = history.begin();
+    for (const CDEmu* cdemu : m_endpoints)
+    {
+        const QTreeWidgetItem* group = groupItem(*cdemu);
+        hasDevices |= group && group->childCount() > 0;
+    }
 
-    while (it != history.end())
+    m_ui->removeDevice->setEnabled(hasDevices);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::restoreSnapshot()
+{
+    QSettings settings;
+    const QVariantMap snapshot = settings.value(DeviceSnapshotKey).toMap();
+
+    for (const CDEmu* cdemu : m_endpoints)
     {
-        if (!QDir().exists(*it))
-            it = history.erase(it);
-        else
-            ++it;
+        QTreeWidgetItem* group = addGroupItem(*cdemu);
+        const QStringList filenames = snapshot.value(snapshotKey(*cdemu)).toStringList();
+
+        for (int i = 0; i < filenames.size(); ++i)
+        {
+            auto item = addDeviceItem(group, i);
+            item->setFileName(filenames.at(i));
+
+            // Disabled until the daemon has confirmed the state
+            item->widget()->setEnabled(false);
+        }
+
+        group->setExpanded(true);
     }
 
-    // Limit size
-    while (history.size() > MaxHistorySize)
-        history.removeLast();
+    updateDeviceActions();
+}
 
-    settings.setValue(HistoryKey, history);
+// ---------------------------------------------------------------------------------------------- //
 
-    // Rebuild menu
-    m_ui->menuHistory->clear();
+void MainWindow::saveSnapshot() const
+{
+    QVariantMap snapshot;
 
-    for (int i = 0; i < history.size(); ++i)
+    for (const CDEmu* cdemu : m_endpoints)
     {
-        QAction* action = m_ui->menuHistory->addAction(history.at(i));
-        action->setData(history.at(i));
-        connect(action, SIGNAL(triggered(bool)), this, SLOT(mountFromHistory()));
+        const QTreeWidgetItem* group = groupItem(*cdemu);
+
+        QStringList filenames;
+
+        for (int i = 0; group && i < group->childCount(); ++i)
+        {
+            if (auto item = dynamic_cast<const DeviceListItem*>(group->child(i)))
+                filenames << item->fileName();
+        }
+
+        snapshot.insert(snapshotKey(*cdemu), filenames);
     }
 
-    m_ui->menuHistory->addSeparator();
+    QSettings settings;
+    settings.setValue(DeviceSnapshotKey, snapshot);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::updateDeviceNodes()
+{
+    QStringList nodes;
+
+    for (const CDEmu* cdemu : m_endpoints)
+    {
+        const QTreeWidgetItem* group = groupItem(*cdemu);
+        const int deviceCount = group ? group->childCount() : 0;
+
+        for (int i = 0; i < deviceCount; ++i)
+            nodes << cdemu->cachedMapping(i).scsiCdRom;
+    }
+
+    m_ioMonitor.setDevices(nodes);
+
+    updateActivity();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::updateActivity()
+{
+    for (const CDEmu* cdemu : m_endpoints)
+    {
+        const QTreeWidgetItem* group = groupItem(*cdemu);
+        const int deviceCount = group ? group->childCount() : 0;
+
+        for (int i = 0; i < deviceCount; ++i)
+        {
+            auto item = deviceItem(*cdemu, i);
+            const QString node = cdemu->cachedMapping(i).scsiCdRom;
+
+            if (!item || node.isEmpty())
+                continue;
+
+            const IoMonitor::Statistics statistics = m_ioMonitor.statistics(node);
+
+            QString text = QFileInfo(node).fileName();
+
+            if (statistics.readsPerSecond > 0.0 || statistics.inFlight > 0)
+            {
+                text += "  " + i18n("%1 reads/s, %2/s, %3 in flight",
+                                    qRound(statistics.readsPerSecond),
+                                    QLocale().formattedDataSize(qint64(statistics.bytesPerSecond)),
+                                    statistics.inFlight);
+            }
+
+            item->setActivityText(text);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::mountDevice(const CDEmu& cdemu, int index)
+{
+    const QString filename = selectImageFile();
+
+    if (filename.isEmpty())
+        return;
+
+    EventTrace::instant("Image selected", index);
+
+    try {
+        mountImage(cdemu, filename, index);
+    }
+    catch (const Exception& e) {
+        MessageBox::error(e.what());
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::mount(int index)
+{
+    mountDevice(senderEndpoint(), index);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::mountToRam(int index)
+{
+    const QString filename = selectImageFile();
+
+    if (filename.isEmpty())
+        return;
+
+    try {
+        mountImage(senderEndpoint(), filename, index, true);
+    }
+    catch (const Exception& e) {
+        MessageBox::error(e.what());
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto MainWindow::selectImageFile() -> QString
+{
+    QSettings settings;
+    QString path = settings.value(LastFilePathKey, QDir::homePath()).toString();
+
+    const QString filename = QFileDialog::getOpenFileName(this, i18n("Select an image file"), path,
+                                                          QString(FileTypes) + ";;" + ArchiveTypes);
+
+    if (filename.isEmpty())
+        return filename;
+
+    path = QFileInfo(filename).path();
+    settings.setValue(LastFilePathKey, path);
+
+    if (!ArchiveExtractor::isArchive(filename))
+        return filename;
+
+    return selectArchiveImage(filename);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto MainWindow::selectArchiveImage(const QString& archive) -> QString
+{
+    QStringList images;
+
+    try {
+        // Unlike the dialogs, reading the listing blocks the event loop
+        const StallDetector::Operation operation("archive listing");
+        images = ArchiveExtractor::images(archive);
+    }
+    catch (const Exception& e) {
+        MessageBox::error(e.what());
+        return QString();
+    }
+
+    if (images.isEmpty())
+    {
+        MessageBox::error(Exception(Error::ImageNotInArchive).what());
+        return QString();
+    }
+
+    if (images.size() == 1)
+        return ArchiveExtractor::join(archive, images.first());
+
+    bool ok = false;
+
+    const QString label = i18n("Images in %1:", QFileInfo(archive).fileName());
+    const QString image = QInputDialog::getItem(this, i18n("Select an image"), label, images, 0,
+                                                false, &ok);
+
+    return ok ? ArchiveExtractor::join(archive, image) : QString();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::unmount(int index)
+{
+    senderEndpoint().requestUnmount(index, this, showError, OperationScheduler::Normal);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::verify(int index)
+{
+    const CDEmu& cdemu = senderEndpoint();
+    const DeviceListItem* item = deviceItem(cdemu, index);
+
+    // The view knows which file is loaded
+    const QString filename = item ? sourceFileName(item->loadedFile()) : QString();
+
+    if (!filename.isEmpty())
+        startVerification(cdemu, filename, index, false, false);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::benchmark(int index)
+{
+    const CDEmu& cdemu = senderEndpoint();
+    DeviceListItem* item = deviceItem(cdemu, index);
+
+    const QString node = cdemu.cachedMapping(index).scsiCdRom;
+    const QString filename = item ? item->loadedFile() : QString();
+
+    if (node.isEmpty() || filename.isEmpty())
+        return;
+
+    item->setStatusText(i18n("Benchmarking..."));
+
+    // Reading the image file directly as well shows how much the emulation costs
+    auto benchmark = new DriveBenchmark(this);
+    addWorker(benchmark);
+
+    connect(benchmark, &DriveBenchmark::finished, this,
+            [this, benchmark, &cdemu, index](const QString& report) {
+        benchmark->deleteLater();
+
+        if (auto item = deviceItem(cdemu, index))
+            setItemFileName(item, item->loadedFile());
+
+        MessageBox::information(report);
+    });
+
+    benchmark->start({ node, ImageFile::dataFile(filename) });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::showDeviceOptions(int index)
+{
+    DeviceOptionsDialog dialog(senderEndpoint(), index, this);
+    dialog.exec();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::mountImage(const CDEmu& cdemu, const QString& filename, int index, bool ram)
+{
+    if (ArchiveExtractor::isArchiveImage(filename))
+    {
+        // Mounting resumes once the image has been extracted
+        startExtraction(cdemu, filename, index);
+        return;
+    }
+
+    if (ImageVerifier::isRequired() && !ImageVerifier::isVerified(filename))
+    {
+        // Mounting resumes once the image has been verified
+        startVerification(cdemu, filename, index, true, ram);
+        return;
+    }
+
+    loadImage(cdemu, filename, index, ram);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::loadImage(const CDEmu& cdemu, const QString& filename, int index, bool ram)
+{
+    const QString image = ImageCache::resolve(filename);
+
+    if (image == filename && ImageCache::isEnabled() && ImageCache::isCacheable(filename))
+        startCaching(filename);
+
+    if (ram)
+    {
+        // Mounting resumes once the image has been copied
+        startStaging(cdemu, filename, image, index);
+        return;
+    }
+
+    requestLoad(cdemu, image, index, [this, filename, image](const QString& error) {
+        if (!error.isEmpty())
+        {
+            if (ArchiveExtractor::isExtracted(image))
+                ArchiveExtractor::discard(image);
+
+            MessageBox::error(error);
+            return;
+        }
+
+        if (ArchiveExtractor::isExtracted(image))
+            ArchiveExtractor::commit(image);
+
+        appendHistory(sourceFileName(filename));
+
+        if (ImageWarmer::isEnabled())
+            startWarmUp(image);
+
+        if (HotSet::isEnabled())
+            startHotSetPrefetch(image);
+    });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::requestLoad(const CDEmu& cdemu, const QString& image, int index,
+                             const std::function<void(const QString& error)>& finished)
+{
+    if (!QFile::exists(image))
+        throw Exception(Error::FileNotFound);
+
+    // Like CDEmu::mount(), but the view knows whether the device is in use
+    if (const DeviceListItem* item = deviceItem(cdemu, index))
+    {
+        if (!item->loadedFile().isEmpty())
+            throw Exception(Error::DeviceInUse);
+    }
+
+    // The profile is applied before the image is loaded, the daemon handles requests in order
+    cdemu.requestOptions(index, DeviceProfile::options(), this,
+                         [this, &cdemu, image, index, finished](bool success) {
+        if (!success)
+        {
+            finished(QString::fromLocal8Bit(Exception(Error::InvalidOption).what()));
+            return;
+        }
+
+        cdemu.requestMount(image, index, this, [finished](const QDBusMessage& reply) {
+            finished(CDEmu::errorOf(reply));
+        }, OperationScheduler::Normal);
+    });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::requestFreeDevice(const DeviceCallback& callback)
+{
+    // Taken from the view, nothing here waits for the daemons
+    const CDEmu& cdemu = mostAvailable();
+
+    for (int i = 0; DeviceListItem* item = deviceItem(cdemu, i); ++i)
+    {
+        if (isFree(item))
+        {
+            callback(cdemu, i);
+            return;
+        }
+    }
+
+    // Every device is busy, so one more is added before anything is copied or extracted for it
+    cdemu.requestAddDevice(this, [this, &cdemu, callback](const QDBusMessage& reply) {
+        const QString error = CDEmu::errorOf(reply);
+
+        if (!error.isEmpty())
+        {
+            MessageBox::error(error);
+            return;
+        }
+
+        auto watcher = new QDBusPendingCallWatcher(cdemu.requestDeviceCount(), this);
+
+        connect(watcher, &QDBusPendingCallWatcher::finished, this,
+                [&cdemu, callback](QDBusPendingCallWatcher* call) {
+            call->deleteLater();
+
+            const QDBusPendingReply<int> count = *call;
+
+            if (count.isError() || count.value() == 0)
+            {
+                MessageBox::error(Exception(Error::DeviceNotAvailable).what());
+                return;
+            }
+
+            callback(cdemu, count.value() - 1);
+        });
+    }, OperationScheduler::Normal);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto MainWindow::mostAvailable() const -> const CDEmu&
+{
+    const CDEmu* best = nullptr;
+    int bestFree = -1;
+    bool hung = false;
+
+    // Like CDEmu::mostAvailable(), the first daemon wins ties and daemons that hang are skipped
+    for (const CDEmu* cdemu : m_endpoints)
+    {
+        if (!cdemu->isDaemonRunning())
+            continue;
+
+        if (!cdemu->isResponsive())
+        {
+            hung = true;
+            continue;
+        }
+
+        int free = 0;
+
+        for (int i = 0; DeviceListItem* item = deviceItem(*cdemu, i); ++i)
+        {
+            if (isFree(item))
+                ++free;
+        }
+
+        if (free > bestFree)
+        {
+            best = cdemu;
+            bestFree = free;
+        }
+    }
+
+    if (!best)
+        throw Exception(hung ? Error::DaemonNotResponding : Error::DaemonNotRunning);
+
+    return *best;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto MainWindow::isFree(const DeviceListItem* item) -> bool
+{
+    // Devices restored from the snapshot haven't been confirmed by the daemon yet
+    return item->widget()->isEnabled() && item->loadedFile().isEmpty();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::startVerification(const CDEmu& cdemu, const QString& filename, int index,
+                                   bool mountWhenVerified, bool ram)
+{
+    auto verifier = new ImageVerifier(this);
+    addWorker(verifier);
+
+    connect(verifier, &ImageVerifier::progressChanged, this, [this, &cdemu, index](int percent) {
+        if (auto item = deviceItem(cdemu, index))
+            item->setStatusText(i18n("Verifying... %1%", percent));
+    });
+
+    connect(verifier, &ImageVerifier::finished, this,
+            [this, verifier, &cdemu, filename, index, mountWhenVerified, ram](
+                    const QString&, ImageVerifier::Result result) {
+        verifier->deleteLater();
+
+        if (auto item = deviceItem(cdemu, index))
+            item->setStatusText(QString());
+
+        switch (result)
+        {
+        case ImageVerifier::Result::Verified:
+            statusBar()->showMessage(i18n("Verified %1", QFileInfo(filename).fileName()), 5000);
+            break;
+
+        case ImageVerifier::Result::Mismatch:
+            MessageBox::error(Exception(Error::ChecksumMismatch).what());
+            return;
+
+        case ImageVerifier::Result::NoReference:
+            if (mountWhenVerified)
+            {
+                MessageBox::error(Exception(Error::ImageNotVerified).what());
+                return;
+            }
+
+            statusBar()->showMessage(i18n("No checksum file found for %1",
+                                          QFileInfo(filename).fileName()), 5000);
+            break;
+
+        default:
+            MessageBox::error(Exception(Error::FileNotReadable).what());
+            return;
+        }
+
+        if (!mountWhenVerified)
+            return;
+
+        try {
+            loadImage(cdemu, filename, index, ram);
+        }
+        catch (const Exception& e) {
+            MessageBox::error(e.what());
+        }
+    });
+
+    verifier->start(filename);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::addWorker(QObject* worker)
+{
+    m_workers.insert(worker);
+
+    // Deleting the window would block until the worker is done and drop what was supposed to
+    // happen afterwards, so a window closed in low-footprint mode goes once the last one is gone
+    connect(worker, &QObject::destroyed, this, [this, worker] {
+        m_workers.remove(worker);
+
+        if (m_workers.isEmpty() && !isVisible() && TrayIcon::isLowFootprint())
+            deleteLater();
+    });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::startCaching(const QString& filename)
+{
+    if (m_caching.contains(filename))
+        return;
+
+    m_caching.insert(filename);
+
+    auto cache = new ImageCache(this);
+    addWorker(cache);
+
+    connect(cache, &ImageCache::finished, this,
+            [this, cache, filename](const QString&, bool success) {
+        cache->deleteLater();
+        m_caching.remove(filename);
+
+        if (!success)
+            return;
+
+        // Expanded images that are mounted are kept even if the cache is over its limit
+        ImageCache::release(loadedFiles());
+
+        statusBar()->showMessage(i18n("Cached %1", QFileInfo(filename).fileName()), 5000);
+    });
+
+    cache->start(filename);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::startStaging(const CDEmu& cdemu, const QString& filename, const QString& image,
+                              int index)
+{
+    auto staging = new RamStaging(this);
+    addWorker(staging);
+
+    connect(staging, &RamStaging::progressChanged, this, [this, &cdemu, index](int percent) {
+        if (auto item = deviceItem(cdemu, index))
+            item->setStatusText(i18n("Copying to RAM... %1%", percent));
+    });
+
+    connect(staging, &RamStaging::finished, this,
+            [this, staging, &cdemu, filename, index](const QString&, const QString& stagedFile,
+                                                     const QString& error) {
+        staging->deleteLater();
+
+        if (auto item = deviceItem(cdemu, index))
+            item->setStatusText(QString());
+
+        if (stagedFile.isEmpty())
+        {
+            MessageBox::error(error);
+            return;
+        }
+
+        try {
+            requestLoad(cdemu, stagedFile, index, [this, filename, stagedFile](
+                                                          const QString& error) {
+                if (!error.isEmpty())
+                {
+                    RamStaging::discard(stagedFile);
+                    MessageBox::error(error);
+                    return;
+                }
+
+                RamStaging::commit(stagedFile);
+                appendHistory(filename);
+            });
+        }
+        catch (const Exception& e) {
+            RamStaging::discard(stagedFile);
+            MessageBox::error(e.what());
+        }
+    });
+
+    staging->start(image);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::startExtraction(const CDEmu& cdemu, const QString& filename, int index)
+{
+    // Nothing is extracted for a device that doesn't exist
+    if (index < 0)
+        throw Exception(Error::DeviceNotAvailable);
+
+    auto extractor = new ArchiveExtractor(this);
+    addWorker(extractor);
+
+    if (auto item = deviceItem(cdemu, index))
+        item->setStatusText(i18n("Extracting..."));
+
+    connect(extractor, &ArchiveExtractor::finished, this,
+            [this, extractor, &cdemu, index](const QString&, const QString& extractedFile,
+                                              const QString& error) {
+        extractor->deleteLater();
+
+        if (auto item = deviceItem(cdemu, index))
+            item->setStatusText(QString());
+
+        if (extractedFile.isEmpty())
+        {
+            MessageBox::error(error);
+            return;
+        }
+
+        // Verified and loaded like any other image, checksum files are extracted along with it
+        try {
+            mountImage(cdemu, extractedFile, index);
+        }
+        catch (const Exception& e) {
+            ArchiveExtractor::discard(extractedFile);
+            MessageBox::error(e.what());
+        }
+    });
+
+    extractor->start(filename);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::startWarmUp(const QString& image)
+{
+    auto warmer = new ImageWarmer(this);
+    addWorker(warmer);
+
+    connect(warmer, &ImageWarmer::finished, this, [this, warmer](const QString&, qint64 bytes) {
+        warmer->deleteLater();
+        statusBar()->showMessage(i18n("Warmed up %1", QLocale().formattedDataSize(bytes)), 5000);
+    });
+
+    warmer->start(image);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::startHotSetPrefetch(const QString& image)
+{
+    auto hotSet = new HotSet(this);
+    addWorker(hotSet);
+
+    connect(hotSet, &HotSet::finished, this, [this, hotSet](const QString&, qint64 bytes) {
+        hotSet->deleteLater();
+
+        if (bytes == 0)
+            return;
+
+        m_hotSetPrefetched += bytes;
+        statusBar()->showMessage(i18n("Prefetched %1 of the hot set",
+                                      QLocale().formattedDataSize(bytes)), 5000);
+    });
+
+    hotSet->start(image);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::mountFromHistory()
+{
+    const auto action = qobject_cast<QAction*>(sender());
+    Q_ASSERT(action != nullptr);
+
+    try {
+        const QString filename = action->data().toString();
+        const QString image = ImageCache::resolve(filename);
+        const bool ram = action->property("ram").toBool();
+
+        // Already mounted images only get their device selected, but a copy in memory doesn't
+        // stand in for the image on disk or vice versa
+        for (const CDEmu* endpoint : m_endpoints)
+        {
+            if (!endpoint->isDaemonRunning())
+                continue;
+
+            const int loaded = ram ? findStagedImage(*endpoint, image)
+                                   : findLoadedImage(*endpoint, image);
+
+            if (loaded < 0)
+                continue;
+
+            if (DeviceListItem* item = deviceItem(*endpoint, loaded))
+                m_ui->deviceList->setCurrentItem(item);
+
+            const QString name = QFileInfo(filename).fileName();
+
+            statusBar()->showMessage(ram ? i18n("%1 is already in RAM on device %2", name, loaded)
+                                         : i18n("%1 is already mounted on device %2", name, loaded),
+                                     5000);
+            return;
+        }
+
+        // Use the daemon with the most free devices
+        requestFreeDevice([this, filename, ram](const CDEmu& cdemu, int index) {
+            try {
+                mountImage(cdemu, filename, index, ram);
+            }
+            catch (const Exception& e) {
+                MessageBox::error(e.what());
+            }
+        });
+    }
+    catch (const Exception& e) {
+        MessageBox::error(e.what());
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::clearHistory()
+{
+    QSettings settings;
+    settings.setValue(HistoryKey, QStringList());
+
+    updateHistory();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::mountDiscSet()
+{
+    QSettings settings;
+    const QString path = settings.value(LastFilePathKey, QDir::homePath()).toString();
+
+    QStringList filenames = QFileDialog::getOpenFileNames(this, i18n("Select the discs of the set"),
+                                                          path, FileTypes);
+
+    if (filenames.isEmpty())
+        return;
+
+    settings.setValue(LastFilePathKey, QFileInfo(filenames.first()).path());
+
+    // So that "Disc 10" comes after "Disc 9"
+    QCollator collator;
+    collator.setNumericMode(true);
+    std::sort(filenames.begin(), filenames.end(), collator);
+
+    bool ok = false;
+
+    const QString suggestion = QFileInfo(filenames.first()).completeBaseName();
+    const QString name = QInputDialog::getText(this, i18n("Disc Set"),
+                                               i18n("Name of the disc set:"), QLineEdit::Normal,
+                                               suggestion, &ok);
+
+    if (!ok || name.isEmpty())
+        return;
+
+    // The whole set is bound to one drive, later discs are swapped in from the tray
+    const auto insert = [this, name, filenames](const CDEmu& cdemu, int index) {
+        try {
+            requestLoad(cdemu, filenames.first(), index,
+                        [this, &cdemu, index, name, filenames](const QString& error) {
+                if (!error.isEmpty())
+                {
+                    MessageBox::error(error);
+                    return;
+                }
+
+                DiscSet set(name, filenames);
+                set.setInserted(cdemu, index, 0);
+
+                statusBar()->showMessage(i18n("Disc set %1 with %2 discs bound to device %3",
+                                              name, filenames.size(), index), 5000);
+            });
+        }
+        catch (const Exception& e) {
+            MessageBox::error(e.what());
+        }
+    };
+
+    try {
+        requestFreeDevice(insert);
+    }
+    catch (const Exception& e) {
+        MessageBox::error(e.what());
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::addDevice()
+{
+    endpoint(m_ui->deviceList->currentItem()).requestAddDevice(this, showError,
+                                                               OperationScheduler::Normal);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::removeDevice()
+{
+    endpoint(m_ui->deviceList->currentItem()).requestRemoveDevice(this, showError,
+                                                                  OperationScheduler::Normal);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::setTrayIconVisible(bool visible)
+{
+    m_tray.setVisible(visible);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::setLowFootprintEnabled(bool enabled)
+{
+    TrayIcon::setLowFootprint(enabled);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::setRequireVerified(bool required)
+{
+    ImageVerifier::setRequired(required);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::setImageCacheEnabled(bool enabled)
+{
+    ImageCache::setEnabled(enabled);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::configureImageCache()
+{
+    bool ok = false;
+
+    const int size = QInputDialog::getInt(this, i18n("Image Cache Size"),
+                                          i18n("Maximum size of decompressed images (MiB):"),
+                                          ImageCache::sizeLimit(), 0, INT_MAX, 1024, &ok);
+
+    if (ok)
+    {
+        ImageCache::setSizeLimit(size);
+        ImageCache::release(loadedFiles());
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::configureRamStaging()
+{
+    bool ok = false;
+
+    const int size = QInputDialog::getInt(this, i18n("RAM Staging Limit"),
+                                          i18n("Maximum memory used by images in RAM (MiB):"),
+                                          RamStaging::memoryLimit(), 0, INT_MAX, 512, &ok);
+
+    if (ok)
+        RamStaging::setMemoryLimit(size);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::configureArchiveScratch()
+{
+    bool ok = false;
+
+    const int size = QInputDialog::getInt(this, i18n("Archive Scratch Space"),
+                                          i18n("Maximum disk space for extracted images (MiB):"),
+                                          ArchiveExtractor::scratchLimit(), 0, INT_MAX, 1024, &ok);
+
+    if (ok)
+        ArchiveExtractor::setScratchLimit(size);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::setWarmUpEnabled(bool enabled)
+{
+    ImageWarmer::setEnabled(enabled);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::setHotSetsEnabled(bool enabled)
+{
+    HotSet::setEnabled(enabled);
+    m_tray.setHotSetSampling(enabled);
+
+    if (!enabled)
+        m_hotSetLabel->hide();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::setRestoreMountsEnabled(bool enabled)
+{
+    MountJournal::setRestoreEnabled(enabled);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::setWatchFolderEnabled(bool enabled)
+{
+    WatchFolder& watchFolder = m_tray.watchFolder();
+
+    if (!enabled)
+    {
+        watchFolder.stop();
+        WatchFolder::setFolder(QString());
+        return;
+    }
+
+    const QString path = QFileDialog::getExistingDirectory(this, i18n("Select a folder to watch"),
+                                                           WatchFolder::folder());
+
+    if (path.isEmpty() || !watchFolder.start(path))
+    {
+        if (!path.isEmpty())
+            MessageBox::error(i18n("Unable to watch %1.", path));
+
+        const QSignalBlocker blocker(m_ui->actionWatchFolder);
+        m_ui->actionWatchFolder->setChecked(false);
+        return;
+    }
+
+    WatchFolder::setFolder(path);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::updateWatchStatus()
+{
+    const WatchFolder& watchFolder = m_tray.watchFolder();
+
+    // The folder may have disappeared
+    if (!watchFolder.isRunning())
+    {
+        const QSignalBlocker blocker(m_ui->actionWatchFolder);
+        m_ui->actionWatchFolder->setChecked(false);
+
+        m_watchLabel->hide();
+        return;
+    }
+
+    const WatchFolder::Statistics statistics = watchFolder.statistics();
+
+    m_watchLabel->setText(i18n("Watch: %1 queued, %2 mounting, %3 mounted, %4 failed, %5 ms",
+                               statistics.queued, statistics.inFlight, statistics.mounted,
+                               statistics.failed, statistics.averageLatency));
+    m_watchLabel->setToolTip(i18n("Watching %1, the last mount took %2 ms",
+                                  watchFolder.path(), statistics.lastLatency));
+    m_watchLabel->show();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::onWatchMountFailed(const QString& filename, const QString& reason)
+{
+    statusBar()->showMessage(i18n("Unable to mount %1: %2", QFileInfo(filename).fileName(), reason),
+                             5000);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::onHotSetLearned(const QString& filename, qint64 size, int hitRate,
+                                 qint64 unknown)
+{
+    m_hotSetLabel->setText(i18n("Hot set: %1%, %2 prefetched", hitRate,
+                                QLocale().formattedDataSize(m_hotSetPrefetched)));
+
+    // Prefetched extents that stayed cached can't be told apart from ones that were read
+    if (unknown > 0)
+    {
+        m_hotSetLabel->setToolTip(i18n("%1 of %2 has been read, %3% of it was prefetched. "
+                                       "Whether %4 of prefetched data has been read is unknown.",
+                                       QLocale().formattedDataSize(size),
+                                       QFileInfo(filename).fileName(), hitRate,
+                                       QLocale().formattedDataSize(unknown)));
+    }
+    else
+    {
+        m_hotSetLabel->setToolTip(i18n("%1 of %2 has been read, %3% of it was prefetched",
+                                       QLocale().formattedDataSize(size),
+                                       QFileInfo(filename).fileName(), hitRate));
+    }
+
+    m_hotSetLabel->show();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::updateSchedulerStatus()
+{
+    OperationScheduler::Statistics total = {};
+    QStringList details;
+
+    for (const CDEmu* cdemu : m_endpoints)
+    {
+        const OperationScheduler::Statistics statistics = cdemu->scheduler().statistics();
+
+        total.queued += statistics.queued;
+        total.inFlight += statistics.inFlight;
+        total.limit += statistics.limit;
+        total.throughput += statistics.throughput;
+
+        if (!cdemu->isResponsive())
+            details << i18n("%1: not responding", cdemu->displayName());
+        else
+        {
+            details << i18n("%1: %2 in flight of %3, %4 ms", cdemu->displayName(),
+                            statistics.inFlight, statistics.limit, statistics.latency);
+        }
+    }
+
+    // Only shown while the daemons have something to do
+    if (total.queued == 0 && total.inFlight == 0 && total.throughput == 0)
+    {
+        m_schedulerLabel->hide();
+        return;
+    }
+
+    m_schedulerLabel->setText(i18n("Daemon: %1 queued, %2/%3 in flight, %4 ops/s", total.queued,
+                                   total.inFlight, total.limit,
+                                   QLocale().toString(total.throughput, 'f', 1)));
+    m_schedulerLabel->setToolTip(details.join('\n'));
+    m_schedulerLabel->show();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::setStallDetectionEnabled(bool enabled)
+{
+    StallDetector::setEnabled(enabled);
+
+    if (enabled)
+        m_stallDetector.start();
+    else
+        m_stallDetector.stop();
+
+    m_stallLabel->setText(m_stallDetector.summary());
+    m_stallLabel->setVisible(enabled);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::configureStallThreshold()
+{
+    bool ok = false;
+
+    const int threshold = QInputDialog::getInt(this, i18n("UI Stall Threshold"),
+                                               i18n("Report stalls of the user interface longer "
+                                                    "than (ms):"),
+                                               StallDetector::threshold(), 1, 10000, 10, &ok);
+
+    if (!ok)
+        return;
+
+    StallDetector::setThreshold(threshold);
+
+    // The watchdog picks up the new threshold when restarted
+    if (m_stallDetector.isRunning())
+    {
+        m_stallDetector.stop();
+        m_stallDetector.start();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::onStallDetected(const QString& operation, int duration)
+{
+    m_stallLabel->setText(m_stallDetector.summary());
+    statusBar()->showMessage(i18n("UI stalled for %1 ms in %2", duration, operation), 5000);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::appendHistory(const QString& filename)
+{
+    QSettings settings;
+    QStringList history = settings.value(HistoryKey).toStringList();
+
+    history.removeAll(filename);
+    history.prepend(filename);
+
+    settings.setValue(HistoryKey, history);
+
+    updateHistory();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MainWindow::updateHistory()
+{
+    const StallDetector::Operation operation("updateHistory");
+
+    QSettings settings;
+    QStringList history = settings.value(HistoryKey).toStringList();
+
+    // Delete invalid entries
+    QStringList::iterator it = history.begin();
+
+    while (it != history.end())
+    {
+        if (!QDir().exists(ArchiveExtractor::archivePath(*it)))
+            it = history.erase(it);
+        else
+            ++it;
+    }
+
+    // Limit size
+    while (history.size() > MaxHistorySize)
+        history.removeLast();
+
+    settings.setValue(HistoryKey, history);
+
+    // Rebuild menu
+    const auto menus = m_ui->menuHistory->findChildren<QMenu*>(QString(),
+                                                               Qt::FindDirectChildrenOnly);
+
+    for (QMenu* menu : menus)
+        menu->deleteLater();
+
+    m_ui->menuHistory->clear();
+
+    for (int i = 0; i < history.size(); ++i)
+    {
+        QAction* action = m_ui->menuHistory->addAction(history.at(i));
+        action->setData(history.at(i));
+        connect(action, SIGNAL(triggered(bool)), this, SLOT(mountFromHistory()));
+    }
+
+    m_ui->menuHistory->addSeparator();
+
+    QMenu* ramMenu = m_ui->menuHistory->addMenu(QIcon::fromTheme("media-flash"),
+                                                i18n("Mount from RAM"));
+    ramMenu->setEnabled(!history.isEmpty());
+
+    for (int i = 0; i < history.size(); ++i)
+    {
+        QAction* action = ramMenu->addAction(history.at(i));
+        action->setData(history.at(i));
+        action->setProperty("ram", true);
+        connect(action, SIGNAL(triggered(bool)), this, SLOT(mountFromHistory()));
+    }
 
     QAction* action = m_ui->menuHistory->addAction(i18n("Clear History"));
     action->setIcon(QIcon::fromTheme("edit-clear-history"));
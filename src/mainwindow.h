@@ -23,15 +23,23 @@
 #define MAINWINDOW_H
 
 #include "cdemu.h"
+#include "imageverifier.h"
+#include "iomonitor.h"
+#include "stalldetector.h"
 
 #include <KHelpMenu>
 #include <KMainWindow>
-#include <KStatusNotifierItem>
 
 #include <QLabel>
+#include <QSet>
+#include <QTreeWidgetItem>
 
+#include <functional>
 #include <memory>
 
+class DeviceListItem;
+class TrayIcon;
+
 namespace Ui {
     class MainWindow;
 }
@@ -41,28 +49,103 @@ class MainWindow : public KMainWindow
     Q_OBJECT
 
 public:
-    MainWindow(const CDEmu& cdemu, QWidget* parent = nullptr);
+    MainWindow(const QList<const CDEmu*>& endpoints, TrayIcon& tray, QWidget* parent = nullptr);
     ~MainWindow() override;
 
+    void mountDevice(const CDEmu& cdemu, int index);
+
 private slots:
     void onDaemonChanged(bool);
     void onDeviceChanged(int index);
 
-    void updateDeviceList();
+    void revalidateDeviceList();
+    void updateDeviceNodes();
+    void updateActivity();
 
     void mount(int index);
+    void mountToRam(int index);
     void unmount(int index);
+    void verify(int index);
+    void benchmark(int index);
+    void showDeviceOptions(int index);
 
     void mountFromHistory();
     void clearHistory();
 
+    void mountDiscSet();
+
     void addDevice();
     void removeDevice();
 
     void setTrayIconVisible(bool visible);
+    void setLowFootprintEnabled(bool enabled);
+    void setRequireVerified(bool required);
+
+    void setImageCacheEnabled(bool enabled);
+    void configureImageCache();
+    void configureRamStaging();
+    void configureArchiveScratch();
+
+    void setWarmUpEnabled(bool enabled);
+    void setHotSetsEnabled(bool enabled);
+    void setRestoreMountsEnabled(bool enabled);
+
+    void setWatchFolderEnabled(bool enabled);
+    void updateWatchStatus();
+    void onWatchMountFailed(const QString& filename, const QString& reason);
+    void onHotSetLearned(const QString& filename, qint64 size, int hitRate, qint64 unknown);
+    void updateSchedulerStatus();
+
+    void setStallDetectionEnabled(bool enabled);
+    void configureStallThreshold();
+    void onStallDetected(const QString& operation, int duration);
 
 private:
+    using DeviceCallback = std::function<void(const CDEmu& cdemu, int index)>;
+
     void closeEvent(QCloseEvent* event) override;
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
+    auto addGroupItem(const CDEmu& cdemu) -> QTreeWidgetItem*;
+    auto addDeviceItem(QTreeWidgetItem* group, int index) -> DeviceListItem*;
+    void applyDeviceStatus(const CDEmu& cdemu, const QList<CDEmu::Status>& statuses);
+    void updateDeviceActions();
+
+    void restoreSnapshot();
+    void saveSnapshot() const;
+
+    auto groupItem(const CDEmu& cdemu) const -> QTreeWidgetItem*;
+    auto deviceItem(const CDEmu& cdemu, int index) const -> DeviceListItem*;
+    void setItemFileName(DeviceListItem* item, const QString& filename);
+    auto loadedFiles() const -> QStringList;
+    auto findLoadedImage(const CDEmu& cdemu, const QString& image) const -> int;
+    auto findStagedImage(const CDEmu& cdemu, const QString& image) const -> int;
+
+    void requestFreeDevice(const DeviceCallback& callback);
+    auto mostAvailable() const -> const CDEmu&;
+    static auto isFree(const DeviceListItem* item) -> bool;
+
+    auto endpoint(QTreeWidgetItem* item) const -> const CDEmu&;
+    auto senderEndpoint() const -> const CDEmu&;
+
+    auto selectImageFile() -> QString;
+    auto selectArchiveImage(const QString& archive) -> QString;
+
+    void restoreMounts(const CDEmu& cdemu);
+
+    void mountImage(const CDEmu& cdemu, const QString& filename, int index, bool ram = false);
+    void loadImage(const CDEmu& cdemu, const QString& filename, int index, bool ram);
+    void requestLoad(const CDEmu& cdemu, const QString& image, int index,
+                     const std::function<void(const QString& error)>& finished);
+    void startVerification(const CDEmu& cdemu, const QString& filename, int index,
+                           bool mountWhenVerified, bool ram);
+    void addWorker(QObject* worker);
+    void startCaching(const QString& filename);
+    void startStaging(const CDEmu& cdemu, const QString& filename, const QString& image, int index);
+    void startExtraction(const CDEmu& cdemu, const QString& filename, int index);
+    void startWarmUp(const QString& image);
+    void startHotSetPrefetch(const QString& image);
 
     void appendHistory(const QString& filename);
     void updateHistory();
@@ -70,12 +153,29 @@ private:
 private:
     std::unique_ptr<Ui::MainWindow> m_ui;
 
-    const CDEmu& m_cdemu;
+    const QList<const CDEmu*> m_endpoints;
+
+    TrayIcon& m_tray;
 
     QLabel* m_statusLabel = nullptr;
+    QLabel* m_stallLabel = nullptr;
+    QLabel* m_watchLabel = nullptr;
+    QLabel* m_hotSetLabel = nullptr;
+    QLabel* m_schedulerLabel = nullptr;
+
+    qint64 m_hotSetPrefetched = 0;
+
+    bool m_daemonLost = false;
+
+    int m_listGeneration = 0;
+
+    QSet<QString> m_caching;
+    QSet<QObject*> m_workers;
+
+    IoMonitor m_ioMonitor;
+    StallDetector m_stallDetector;
 
     KHelpMenu* m_helpMenu = nullptr;
-    KStatusNotifierItem* m_trayIcon = nullptr;
 };
 
 #endif // MAINWINDOW_H
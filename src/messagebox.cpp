@@ -32,3 +32,10 @@ void MessageBox::error(const QString& text)
 }
 
 // ---------------------------------------------------------------------------------------------- //
+
+void MessageBox::information(const QString& text)
+{
+    KMessageBox::information(nullptr, text, i18n("Information"));
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -28,6 +28,7 @@ class MessageBox
 {
 public:
     static void error(const QString& text);
+    static void information(const QString& text);
 };
 
 #endif // MESSAGEBOX_H
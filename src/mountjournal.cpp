@@ -0,0 +1,213 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "cdemu.h"
+#include "mountjournal.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QUrl>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr qint64 MaxSize = 64 * 1024;
+
+    constexpr const char* RestoreMountsKey = "restoreMounts";
+
+    constexpr char MountRecord = 'M';
+    constexpr char UnmountRecord = 'U';
+
+    // The state the journal describes, valid as long as its size hasn't changed
+    QMap<int, QString> Recorded;
+    qint64 RecordedSize = -1;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto MountJournal::isRestoreEnabled() -> bool
+{
+    QSettings settings;
+    return settings.value(RestoreMountsKey, true).toBool();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MountJournal::setRestoreEnabled(bool enabled)
+{
+    QSettings settings;
+    settings.setValue(RestoreMountsKey, enabled);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MountJournal::recordMount(int index, const QString& filename)
+{
+    append(QByteArray(1, MountRecord) + '\t' + QByteArray::number(index) + '\t' +
+           QUrl::toPercentEncoding(filename));
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MountJournal::recordUnmount(int index)
+{
+    append(QByteArray(1, UnmountRecord) + '\t' + QByteArray::number(index));
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MountJournal::recordState(int index, const QString& filename)
+{
+    // Other processes append as well, in which case the journal has to be read again
+    const qint64 size = QFileInfo(path()).size();
+
+    if (size != RecordedSize)
+    {
+        Recorded = state();
+        RecordedSize = size;
+    }
+
+    // Status changes are reported for more than loading and unloading
+    if (Recorded.value(index) == filename)
+        return;
+
+    if (filename.isEmpty())
+    {
+        recordUnmount(index);
+        Recorded.remove(index);
+    }
+    else
+    {
+        recordMount(index, filename);
+        Recorded.insert(index, filename);
+    }
+
+    RecordedSize = QFileInfo(path()).size();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto MountJournal::state() -> QMap<int, QString>
+{
+    QMap<int, QString> state;
+
+    QFile file(path());
+
+    if (!file.open(QIODevice::ReadOnly))
+        return state;
+
+    // Later records override earlier ones, a torn last line is simply ignored
+    while (!file.atEnd())
+    {
+        const QByteArray line = file.readLine();
+
+        if (!line.endsWith('\n'))
+            break;
+
+        const QList<QByteArray> fields = line.trimmed().split('\t');
+
+        bool ok = false;
+        const int index = fields.value(1).toInt(&ok);
+
+        if (!ok || index < 0)
+            continue;
+
+        if (fields.at(0) == QByteArray(1, MountRecord) && fields.size() == 3)
+            state.insert(index, QUrl::fromPercentEncoding(fields.at(2)));
+        else if (fields.at(0) == QByteArray(1, UnmountRecord))
+            state.remove(index);
+    }
+
+    return state;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto MountJournal::restore(const CDEmu& cdemu) -> int
+{
+    const QMap<int, QString> mounts = state();
+
+    if (mounts.isEmpty())
+        return 0;
+
+    // All missing devices and images are requested at once instead of one by one
+    const int missing = mounts.lastKey() + 1 - cdemu.getDeviceCount();
+
+    if (missing > 0)
+        cdemu.addDevices(missing);
+
+    return cdemu.mountAll(mounts);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MountJournal::append(const QByteArray& record)
+{
+    QDir().mkpath(QFileInfo(path()).path());
+
+    QFile file(path());
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+        return;
+
+    // Only has to survive the daemon or the session going away, not a power loss, so the page
+    // cache is enough and nothing waits for the disk
+    file.write(record + '\n');
+    file.flush();
+
+    if (file.size() > MaxSize)
+    {
+        file.close();
+        compact(state());
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MountJournal::compact(const QMap<int, QString>& state)
+{
+    // Replaces the journal atomically, so a crash leaves either the old or the new one
+    QSaveFile file(path());
+
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    for (auto it = state.cbegin(); it != state.cend(); ++it)
+    {
+        file.write(QByteArray(1, MountRecord) + '\t' + QByteArray::number(it.key()) + '\t' +
+                   QUrl::toPercentEncoding(it.value()) + '\n');
+    }
+
+    file.commit();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto MountJournal::path() -> QString
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/mounts.journal";
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,50 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef MOUNTJOURNAL_H
+#define MOUNTJOURNAL_H
+
+#include <QMap>
+#include <QString>
+
+class CDEmu;
+
+class MountJournal
+{
+public:
+    static auto isRestoreEnabled() -> bool;
+    static void setRestoreEnabled(bool enabled);
+
+    static void recordMount(int index, const QString& filename);
+    static void recordUnmount(int index);
+    static void recordState(int index, const QString& filename);
+
+    static auto state() -> QMap<int, QString>;
+    static auto restore(const CDEmu& cdemu) -> int;
+
+private:
+    static void append(const QByteArray& record);
+    static void compact(const QMap<int, QString>& state);
+
+    static auto path() -> QString;
+};
+
+#endif // MOUNTJOURNAL_H
@@ -0,0 +1,379 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "eventtrace.h"
+#include "operationscheduler.h"
+#include "trafficrecorder.h"
+
+#include <QDBusError>
+#include <QDBusPendingCallWatcher>
+
+#include <algorithm>
+#include <atomic>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr double InitialLimit = 4;
+    constexpr double MinLimit = 1;
+    constexpr double MaxLimit = 64;
+
+    // Replies may take this much longer than twice the fastest one before the daemon counts as busy
+    constexpr qint64 LatencySlack = 10;
+
+    constexpr qint64 ThroughputWindow = 5000;
+
+    // A query is answered from the daemon's state, one that takes longer than this is hung
+    constexpr int QueryTimeout = 2000;
+    constexpr int ChangeTimeout = 10000;
+
+    // How often blocking callers still try a daemon that has stopped responding
+    constexpr qint64 ProbeInterval = 5000;
+
+    // Trace ids have to be unique across the schedulers of all daemons
+    std::atomic<quint32> NextTrace(0);
+
+    auto traceDevice(const QDBusMessage& method) -> int
+    {
+        const QList<QVariant> arguments = method.arguments();
+        return arguments.isEmpty() ? -1 : arguments.constFirst().toInt();
+    }
+
+    auto timeout(const QDBusMessage& method) -> int
+    {
+        // Loading an image may take a while, asking about the devices never should
+        return method.member().contains("Get") ? QueryTimeout : ChangeTimeout;
+    }
+
+    auto notResponding(const QDBusMessage& method) -> QDBusMessage
+    {
+        return method.createErrorReply(QDBusError::NoReply, "The daemon is not responding");
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+OperationScheduler::OperationScheduler(const QDBusConnection& connection, QObject* parent)
+    : QObject(parent),
+      m_connection(connection),
+      m_limit(InitialLimit),
+      m_throughputTimer(this)
+{
+    m_clock.start();
+
+    // Lets the throughput drop back to zero once the daemon is idle
+    m_throughputTimer.setInterval(1000);
+    connect(&m_throughputTimer, SIGNAL(timeout()), this, SLOT(expireThroughput()));
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto OperationScheduler::call(const QDBusMessage& method) -> QDBusMessage
+{
+    if (!mayBlock())
+        return notResponding(method);
+
+    // The caller is blocked anyway, so this is never queued
+    const Sample sample = begin(Interactive, method);
+    const QDBusMessage reply = m_connection.call(method, QDBus::Block, timeout(method));
+    end(Interactive, sample, true, method, reply);
+
+    pump();
+
+    return reply;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto OperationScheduler::callAll(const QList<QDBusMessage>& methods, Priority priority)
+    -> QList<QDBusMessage>
+{
+    QList<QDBusPendingCall> calls;
+    QList<Sample> samples;
+    QList<QDBusMessage> replies;
+
+    if (!mayBlock())
+    {
+        for (const QDBusMessage& method : methods)
+            replies << notResponding(method);
+
+        return replies;
+    }
+
+    while (replies.size() < methods.size())
+    {
+        // Interactive requests all go out at once, the others only as long as there's room
+        while (calls.size() < methods.size() &&
+               (calls.size() == replies.size() || hasRoom(priority)))
+        {
+            samples << begin(priority, methods.at(calls.size()));
+            calls << m_connection.asyncCall(methods.at(calls.size()),
+                                            timeout(methods.at(calls.size())));
+        }
+
+        const int next = replies.size();
+
+        calls[next].waitForFinished();
+        replies << calls.at(next).reply();
+
+        end(priority, samples.at(next), true, methods.at(next), replies.last());
+    }
+
+    pump();
+
+    return replies;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto OperationScheduler::dispatch(const QDBusMessage& method) -> QDBusPendingCall
+{
+    const Sample sample = begin(Interactive, method);
+    const QDBusPendingCall call = m_connection.asyncCall(method, timeout(method));
+
+    // The caller may block on the reply, in which case the watcher only sees it late
+    auto watcher = new QDBusPendingCallWatcher(call, this);
+
+    connect(watcher, &QDBusPendingCallWatcher::finished, this,
+            [this, method, sample](QDBusPendingCallWatcher* finished) {
+        finished->deleteLater();
+
+        end(Interactive, sample, false, method, finished->reply());
+        pump();
+    });
+
+    return call;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void OperationScheduler::submit(const QDBusMessage& method, Priority priority, QObject* context,
+                                const Callback& callback)
+{
+    Q_ASSERT(!callback || context);
+
+    // Operations of the same priority are sent in order, others may overtake them
+    m_queues[priority].enqueue({ method, context, callback });
+
+    pump();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto OperationScheduler::statistics() const -> Statistics
+{
+    const qint64 now = m_clock.elapsed();
+
+    const auto completions = std::count_if(m_completions.cbegin(), m_completions.cend(),
+                                           [now](qint64 time) {
+        return now - time < ThroughputWindow;
+    });
+
+    Statistics statistics = {};
+
+    for (int priority = Interactive; priority <= Bulk; ++priority)
+    {
+        statistics.queued += m_queues[priority].size();
+        statistics.inFlight += m_inFlight[priority];
+    }
+
+    statistics.limit = int(m_limit);
+    statistics.latency = qRound(m_latency);
+    statistics.throughput = completions * 1000.0 / ThroughputWindow;
+
+    return statistics;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto OperationScheduler::isResponsive() const -> bool
+{
+    return m_responsive;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto OperationScheduler::isTimeout(const QDBusMessage& reply) -> bool
+{
+    const QDBusError::ErrorType type = QDBusError(reply).type();
+    return type == QDBusError::NoReply || type == QDBusError::Timeout;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void OperationScheduler::pump()
+{
+    bool sent = false;
+
+    for (int priority = Interactive; priority <= Bulk; ++priority)
+    {
+        const auto p = Priority(priority);
+
+        while (!m_queues[p].isEmpty() && hasRoom(p))
+        {
+            const Operation operation = m_queues[p].dequeue();
+            const Sample sample = begin(p, operation.method);
+
+            const QDBusPendingCall call = m_connection.asyncCall(operation.method,
+                                                                 timeout(operation.method));
+
+            auto watcher = new QDBusPendingCallWatcher(call, this);
+
+            connect(watcher, &QDBusPendingCallWatcher::finished, this,
+                    [this, operation, sample, p](QDBusPendingCallWatcher* finished) {
+                finished->deleteLater();
+
+                end(p, sample, true, operation.method, finished->reply());
+
+                if (operation.callback && operation.context)
+                    operation.callback(finished->reply());
+
+                pump();
+            });
+
+            sent = true;
+        }
+    }
+
+    if (sent)
+        emit statisticsChanged();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void OperationScheduler::expireThroughput()
+{
+    const qint64 now = m_clock.elapsed();
+
+    while (!m_completions.isEmpty() && now - m_completions.head() >= ThroughputWindow)
+        m_completions.dequeue();
+
+    if (m_completions.isEmpty())
+        m_throughputTimer.stop();
+
+    emit statisticsChanged();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto OperationScheduler::begin(Priority priority, const QDBusMessage& method) -> Sample
+{
+    ++m_inFlight[priority];
+
+    // From sending to the reply, whether the caller blocks on it or not
+    const quint32 trace = ++NextTrace;
+    EventTrace::beginAsync(method.member().toLatin1().constData(), trace, traceDevice(method));
+
+    return { m_clock.elapsed(), ++m_sequence, trace };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void OperationScheduler::end(Priority priority, const Sample& sample, bool measured,
+                             const QDBusMessage& method, const QDBusMessage& reply)
+{
+    const qint64 now = m_clock.elapsed();
+    const qint64 latency = now - sample.sentAt;
+
+    EventTrace::endAsync(method.member().toLatin1().constData(), sample.trace,
+                         traceDevice(method));
+    TrafficRecorder::recordCall(method, reply, latency);
+
+    --m_inFlight[priority];
+
+    // Any answer at all, even an error, shows the daemon is alive
+    const bool responsive = !isTimeout(reply);
+
+    if (responsive != m_responsive)
+    {
+        m_responsive = responsive;
+        m_lastProbe = now;
+    }
+
+    m_completions.enqueue(now);
+
+    if (!m_throughputTimer.isActive())
+        m_throughputTimer.start();
+
+    if (measured)
+    {
+        m_latency = m_latency == 0 ? latency : m_latency * 0.875 + latency * 0.125;
+
+        // Follows the daemon slowly when everything gets slower, like on a loaded system
+        if (m_baseLatency < 0 || latency < m_baseLatency)
+            m_baseLatency = latency;
+        else
+            m_baseLatency += (latency - m_baseLatency) / 256;
+
+        if (latency > 2 * m_baseLatency + LatencySlack)
+        {
+            // Replies to everything sent before the last decrease are from the same congestion
+            if (sample.sequence > m_lastDecrease)
+            {
+                m_limit = std::max(MinLimit, m_limit / 2);
+                m_lastDecrease = m_sequence;
+            }
+        }
+        else
+        {
+            m_limit = std::min(MaxLimit, m_limit + 1 / m_limit);
+        }
+    }
+
+    emit statisticsChanged();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto OperationScheduler::hasRoom(Priority priority) const -> bool
+{
+    if (priority == Interactive)
+        return true;
+
+    const int limit = int(m_limit);
+    const int used = m_inFlight[Normal] + m_inFlight[Bulk];
+
+    if (priority == Normal)
+        return used < limit;
+
+    // Bulk work leaves room for whatever the user is waiting for
+    return used < std::max(1, limit - m_inFlight[Interactive]);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto OperationScheduler::mayBlock() -> bool
+{
+    if (m_responsive)
+        return true;
+
+    // Calls that don't block keep going out and notice when the daemon is back, blocking ones
+    // only try every once in a while
+    const qint64 now = m_clock.elapsed();
+
+    if (now - m_lastProbe < ProbeInterval)
+        return false;
+
+    m_lastProbe = now;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------- //
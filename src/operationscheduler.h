@@ -0,0 +1,126 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef OPERATIONSCHEDULER_H
+#define OPERATIONSCHEDULER_H
+
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCall>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPointer>
+#include <QQueue>
+#include <QTimer>
+
+#include <functional>
+
+class OperationScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Priority
+    {
+        Interactive, // Someone is waiting for the reply, sent right away
+        Normal,      // Changes made by the user
+        Bulk         // Background work like the watch folder and batches
+    };
+
+    using Callback = std::function<void(const QDBusMessage& reply)>;
+
+    struct Statistics
+    {
+        int queued;
+        int inFlight;
+        int limit;
+        int latency;
+        double throughput;
+    };
+
+public:
+    explicit OperationScheduler(const QDBusConnection& connection, QObject* parent = nullptr);
+
+    auto call(const QDBusMessage& method) -> QDBusMessage;
+    auto callAll(const QList<QDBusMessage>& methods, Priority priority) -> QList<QDBusMessage>;
+
+    auto dispatch(const QDBusMessage& method) -> QDBusPendingCall;
+    void submit(const QDBusMessage& method, Priority priority, QObject* context = nullptr,
+                const Callback& callback = Callback());
+
+    auto statistics() const -> Statistics;
+    auto isResponsive() const -> bool;
+
+    static auto isTimeout(const QDBusMessage& reply) -> bool;
+
+signals:
+    void statisticsChanged();
+
+private slots:
+    void pump();
+    void expireThroughput();
+
+private:
+    struct Operation
+    {
+        QDBusMessage method;
+        QPointer<QObject> context;
+        Callback callback;
+    };
+
+    struct Sample
+    {
+        qint64 sentAt;
+        quint64 sequence;
+        quint32 trace;
+    };
+
+    auto begin(Priority priority, const QDBusMessage& method) -> Sample;
+    void end(Priority priority, const Sample& sample, bool measured, const QDBusMessage& method,
+             const QDBusMessage& reply);
+
+    auto hasRoom(Priority priority) const -> bool;
+    auto mayBlock() -> bool;
+
+private:
+    QDBusConnection m_connection;
+
+    QQueue<Operation> m_queues[Bulk + 1];
+    int m_inFlight[Bulk + 1] = {};
+
+    // Additive increase, multiplicative decrease, like TCP does for its window
+    double m_limit;
+    quint64 m_sequence = 0;
+    quint64 m_lastDecrease = 0;
+
+    qint64 m_baseLatency = -1;
+    double m_latency = 0;
+
+    // Set by a call that timed out, cleared by the next reply
+    bool m_responsive = true;
+    qint64 m_lastProbe = 0;
+
+    QElapsedTimer m_clock;
+    QQueue<qint64> m_completions;
+    QTimer m_throughputTimer;
+};
+
+#endif // OPERATIONSCHEDULER_H
@@ -0,0 +1,354 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "exception.h"
+#include "imagefile.h"
+#include "ramstaging.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QStorageInfo>
+#include <QTemporaryDir>
+#include <QThread>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr int DefaultMemoryLimit = 4096; // MiB
+    constexpr qint64 BufferSize = 8 * 1024 * 1024;
+    constexpr qint64 PendingTimeout = 60 * 60; // Seconds
+
+    constexpr const char* RamStagingLimitKey = "ramStagingLimit";
+
+    constexpr const char* PendingMarker = ".pending";
+    constexpr const char* SourceFile = ".source";
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+RamStaging::RamStaging(QObject* parent)
+    : QObject(parent) {}
+
+// ---------------------------------------------------------------------------------------------- //
+
+RamStaging::~RamStaging()
+{
+    if (m_thread)
+    {
+        m_thread->wait();
+        delete m_thread;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void RamStaging::start(const QString& filename)
+{
+    Q_ASSERT(!isRunning());
+
+    delete m_thread;
+
+    m_thread = QThread::create([this, filename] {
+        QString stagedFile;
+        QString error;
+
+        try {
+            stagedFile = stage(filename, [this](int percent) {
+                emit progressChanged(percent);
+            });
+        }
+        catch (const Exception& e) {
+            error = QString::fromLocal8Bit(e.what());
+        }
+
+        emit finished(filename, stagedFile, error);
+    });
+
+    m_thread->start();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto RamStaging::isRunning() const -> bool
+{
+    return m_thread && m_thread->isRunning();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto RamStaging::memoryLimit() -> int
+{
+    QSettings settings;
+    return settings.value(RamStagingLimitKey, DefaultMemoryLimit).toInt();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void RamStaging::setMemoryLimit(int megabytes)
+{
+    QSettings settings;
+    settings.setValue(RamStagingLimitKey, megabytes);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto RamStaging::memoryUsage() -> qint64
+{
+    qint64 usage = 0;
+
+    QDirIterator it(directory(), QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+
+    while (it.hasNext())
+    {
+        it.next();
+        usage += it.fileInfo().size();
+    }
+
+    return usage;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto RamStaging::stage(const QString& filename, const ProgressCallback& progress) -> QString
+{
+    const QFileInfo info(filename);
+    const QStringList files = QStringList(info.absoluteFilePath()) +
+                              ImageFile::trackFiles(filename);
+
+    qint64 total = 0;
+
+    for (const QString& file : files)
+    {
+        const QFileInfo fileInfo(file);
+
+        if (!fileInfo.exists())
+            throw Exception(Error::FileNotFound);
+
+        // Track files are copied relative to the image, so they have to live next to it
+        if (info.dir().relativeFilePath(file).startsWith(".."))
+            throw Exception(Error::StagingFailed);
+
+        total += fileInfo.size();
+    }
+
+    if (memoryUsage() + total > qint64(memoryLimit()) * 1024 * 1024)
+        throw Exception(Error::InsufficientMemory);
+
+    if (!QDir().mkpath(directory()))
+        throw Exception(Error::StagingFailed);
+
+    if (QStorageInfo(directory()).bytesAvailable() < total)
+        throw Exception(Error::InsufficientMemory);
+
+    // Removed again if anything goes wrong while copying
+    QTemporaryDir staging(directory() + "/XXXXXX");
+
+    if (!staging.isValid())
+        throw Exception(Error::StagingFailed);
+
+    QFile marker(staging.filePath(PendingMarker));
+    marker.open(QIODevice::WriteOnly);
+
+    QFile source(staging.filePath(SourceFile));
+
+    if (source.open(QIODevice::WriteOnly))
+        source.write(filename.toUtf8());
+
+    QByteArray buffer(BufferSize, Qt::Uninitialized);
+
+    qint64 copied = 0;
+    int percent = -1;
+
+    for (const QString& file : files)
+    {
+        const QString target = staging.filePath(info.dir().relativeFilePath(file));
+
+        if (!QDir().mkpath(QFileInfo(target).path()))
+            throw Exception(Error::StagingFailed);
+
+        QFile input(file);
+        QFile output(target);
+
+        if (!input.open(QIODevice::ReadOnly))
+            throw Exception(Error::FileNotReadable);
+
+        if (!output.open(QIODevice::WriteOnly))
+            throw Exception(Error::StagingFailed);
+
+        while (!input.atEnd())
+        {
+            const qint64 length = input.read(buffer.data(), buffer.size());
+
+            if (length < 0)
+                throw Exception(Error::FileNotReadable);
+
+            if (output.write(buffer.constData(), length) != length)
+                throw Exception(Error::InsufficientMemory);
+
+            copied += length;
+
+            if (progress && total > 0 && copied * 100 / total != percent)
+            {
+                percent = int(copied * 100 / total);
+                progress(percent);
+            }
+        }
+    }
+
+    staging.setAutoRemove(false);
+
+    return staging.filePath(info.fileName());
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void RamStaging::commit(const QString& stagedFile)
+{
+    const QString path = stagingDirectory(stagedFile);
+
+    if (!path.isEmpty())
+        QFile::remove(path + "/" + PendingMarker);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void RamStaging::discard(const QString& stagedFile)
+{
+    const QString path = stagingDirectory(stagedFile);
+
+    if (!path.isEmpty())
+        QDir(path).removeRecursively();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto RamStaging::hasStagedImages() -> bool
+{
+    return !QDir(directory()).entryList(QDir::Dirs | QDir::NoDotAndDotDot).isEmpty();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto RamStaging::isStaged(const QString& filename) -> bool
+{
+    return !stagingDirectory(filename).isEmpty() && QFile::exists(filename);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto RamStaging::stagedSize(const QString& filename) -> qint64
+{
+    const QString path = stagingDirectory(filename);
+
+    if (path.isEmpty())
+        return 0;
+
+    qint64 size = 0;
+
+    QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+
+    while (it.hasNext())
+    {
+        it.next();
+        size += it.fileInfo().size();
+    }
+
+    return size;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto RamStaging::originalPath(const QString& filename) -> QString
+{
+    const QString path = stagingDirectory(filename);
+
+    if (path.isEmpty())
+        return filename;
+
+    QFile source(path + "/" + SourceFile);
+
+    if (!source.open(QIODevice::ReadOnly))
+        return filename;
+
+    return QString::fromUtf8(source.readAll());
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void RamStaging::release(const QStringList& loadedFiles)
+{
+    const QDir base(directory());
+
+    for (const QString& name : base.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        const QString path = base.absoluteFilePath(name);
+
+        // Still being copied or just about to be mounted
+        const QFileInfo pending(path + "/" + PendingMarker);
+
+        if (pending.exists() &&
+            pending.lastModified().secsTo(QDateTime::currentDateTime()) < PendingTimeout)
+            continue;
+
+        bool loaded = false;
+
+        for (const QString& file : loadedFiles)
+        {
+            if (stagingDirectory(file) == path)
+            {
+                loaded = true;
+                break;
+            }
+        }
+
+        if (!loaded)
+            QDir(path).removeRecursively();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto RamStaging::directory() -> QString
+{
+    // The runtime directory is a per-user tmpfs
+    return QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation) + "/kde_cdemu/staging";
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto RamStaging::stagingDirectory(const QString& stagedFile) -> QString
+{
+    if (stagedFile.isEmpty())
+        return QString();
+
+    const QString relative = QDir(directory()).relativeFilePath(stagedFile);
+
+    if (relative.startsWith("..") || QFileInfo(relative).isAbsolute() || !relative.contains('/'))
+        return QString();
+
+    return directory() + "/" + relative.section('/', 0, 0);
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,75 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef RAMSTAGING_H
+#define RAMSTAGING_H
+
+#include <QObject>
+#include <QStringList>
+
+#include <functional>
+
+class QThread;
+
+class RamStaging : public QObject
+{
+    Q_OBJECT
+
+public:
+    using ProgressCallback = std::function<void(int)>;
+
+public:
+    RamStaging(QObject* parent = nullptr);
+    ~RamStaging() override;
+
+    void start(const QString& filename);
+    auto isRunning() const -> bool;
+
+    static auto memoryLimit() -> int;
+    static void setMemoryLimit(int megabytes);
+    static auto memoryUsage() -> qint64;
+
+    static auto stage(const QString& filename,
+                      const ProgressCallback& progress = ProgressCallback()) -> QString;
+
+    static void commit(const QString& stagedFile);
+    static void discard(const QString& stagedFile);
+
+    static auto hasStagedImages() -> bool;
+    static auto isStaged(const QString& filename) -> bool;
+    static auto stagedSize(const QString& filename) -> qint64;
+    static auto originalPath(const QString& filename) -> QString;
+
+    static void release(const QStringList& loadedFiles);
+
+signals:
+    void progressChanged(int percent);
+    void finished(const QString& filename, const QString& stagedFile, const QString& error);
+
+private:
+    static auto directory() -> QString;
+    static auto stagingDirectory(const QString& stagedFile) -> QString;
+
+private:
+    QThread* m_thread = nullptr;
+};
+
+#endif // RAMSTAGING_H
@@ -0,0 +1,232 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "stalldetector.h"
+
+#include <KLocalizedString>
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QStringList>
+#include <QThread>
+
+#include <mutex>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr int DefaultThreshold = 50; // ms
+    constexpr int MinPollInterval = 5;   // ms
+
+    constexpr const char* DetectStallsKey = "detectStalls";
+    constexpr const char* StallThresholdKey = "stallThreshold";
+
+    // Innermost operation last, only ever changed by the main thread
+    std::mutex OperationMutex;
+    QStringList Operations;
+
+    auto monotonicTime() -> qint64
+    {
+        static QElapsedTimer timer;
+
+        if (!timer.isValid())
+            timer.start();
+
+        return timer.elapsed();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+StallDetector::Operation::Operation(const QString& name)
+{
+    const std::lock_guard<std::mutex> lock(OperationMutex);
+    Operations << name;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+StallDetector::Operation::~Operation()
+{
+    const std::lock_guard<std::mutex> lock(OperationMutex);
+    Operations.removeLast();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+StallDetector::StallDetector(QObject* parent)
+    : QObject(parent),
+      m_stopping(false),
+      m_answered(0)
+{
+    monotonicTime(); // Start the clock on the main thread
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+StallDetector::~StallDetector()
+{
+    stop();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void StallDetector::start()
+{
+    if (isRunning())
+        return;
+
+    delete m_thread;
+
+    m_stopping = false;
+
+    const int limit = threshold();
+    const int interval = qMax(MinPollInterval, limit / 4);
+
+    // The watchdog posts a heartbeat to the event loop and measures how long it takes to be handled
+    m_thread = QThread::create([this, limit, interval] {
+        while (!m_stopping)
+        {
+            const qint64 sent = monotonicTime();
+
+            QMetaObject::invokeMethod(this, [this, sent] { m_answered = sent; },
+                                      Qt::QueuedConnection);
+
+            QString operation;
+
+            while (m_answered != sent && !m_stopping)
+            {
+                QThread::msleep(interval);
+
+                // Sampled while the stall is still going on
+                if (operation.isEmpty() && monotonicTime() - sent > limit)
+                    operation = currentOperation();
+            }
+
+            const int duration = int(monotonicTime() - sent);
+
+            if (duration > limit && !m_stopping)
+            {
+                QMetaObject::invokeMethod(this, [this, operation, duration] {
+                    onStall(operation, duration);
+                }, Qt::QueuedConnection);
+            }
+
+            QThread::msleep(interval);
+        }
+    });
+
+    m_thread->start();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void StallDetector::stop()
+{
+    if (!m_thread)
+        return;
+
+    m_stopping = true;
+
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto StallDetector::isRunning() const -> bool
+{
+    return m_thread && m_thread->isRunning();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto StallDetector::summary() const -> QString
+{
+    if (m_stallCount == 0)
+        return i18n("No UI stalls");
+
+    return i18np("1 UI stall, longest %2 ms in %3", "%1 UI stalls, longest %2 ms in %3",
+                 m_stallCount, m_longestStall, m_longestOperation);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto StallDetector::isEnabled() -> bool
+{
+    QSettings settings;
+    return settings.value(DetectStallsKey, false).toBool();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void StallDetector::setEnabled(bool enabled)
+{
+    QSettings settings;
+    settings.setValue(DetectStallsKey, enabled);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto StallDetector::threshold() -> int
+{
+    QSettings settings;
+    return qMax(1, settings.value(StallThresholdKey, DefaultThreshold).toInt());
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void StallDetector::setThreshold(int threshold)
+{
+    QSettings settings;
+    settings.setValue(StallThresholdKey, threshold);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void StallDetector::onStall(const QString& operation, int duration)
+{
+    const QString name = operation.isEmpty() ? i18n("event handling") : operation;
+
+    qWarning() << "Main thread stalled for" << duration << "ms in" << name;
+
+    ++m_stallCount;
+
+    if (duration > m_longestStall)
+    {
+        m_longestStall = duration;
+        m_longestOperation = name;
+    }
+
+    emit stallDetected(name, duration);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto StallDetector::currentOperation() -> QString
+{
+    const std::lock_guard<std::mutex> lock(OperationMutex);
+    return Operations.join(" > ");
+}
+
+// ---------------------------------------------------------------------------------------------- //
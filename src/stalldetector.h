@@ -0,0 +1,83 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef STALLDETECTOR_H
+#define STALLDETECTOR_H
+
+#include <QObject>
+#include <QString>
+
+#include <atomic>
+
+class QThread;
+
+class StallDetector : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Marks what the main thread is busy with, so stalls can be attributed to it
+    class Operation
+    {
+    public:
+        explicit Operation(const QString& name);
+        ~Operation();
+
+        Operation(const Operation&) = delete;
+        auto operator=(const Operation&) -> Operation& = delete;
+    };
+
+public:
+    StallDetector(QObject* parent = nullptr);
+    ~StallDetector() override;
+
+    void start();
+    void stop();
+
+    auto isRunning() const -> bool;
+    auto summary() const -> QString;
+
+    static auto isEnabled() -> bool;
+    static void setEnabled(bool enabled);
+
+    static auto threshold() -> int;
+    static void setThreshold(int threshold);
+
+signals:
+    void stallDetected(const QString& operation, int duration);
+
+private:
+    void onStall(const QString& operation, int duration);
+
+    static auto currentOperation() -> QString;
+
+private:
+    QThread* m_thread = nullptr;
+
+    std::atomic<bool> m_stopping;
+    std::atomic<qint64> m_answered;
+
+    int m_stallCount = 0;
+    int m_longestStall = 0;
+    QString m_longestOperation;
+};
+
+#endif // STALLDETECTOR_H
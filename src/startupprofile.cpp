@@ -0,0 +1,260 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "eventtrace.h"
+#include "startupprofile.h"
+
+#include <QApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QHash>
+#include <QProcess>
+#include <QStringList>
+#include <QTextStream>
+#include <QTimer>
+#include <QWidget>
+#include <QWindow>
+
+#include <algorithm>
+#include <chrono>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    // Reopening the window adds phases, but only the first start matters
+    constexpr int MaxEntries = 256;
+
+    constexpr int ChildTimeout = 60000; // ms
+
+    // Only touched by the main thread
+    QList<StartupProfile::Entry> Entries;
+    int Depth = 0;
+    qint64 Origin = -1;
+
+    auto now() -> qint64
+    {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    auto median(QList<double> values) -> double
+    {
+        std::sort(values.begin(), values.end());
+        return values.isEmpty() ? 0.0 : values.at(values.size() / 2);
+    }
+
+    class FrameWatcher : public QObject
+    {
+    public:
+        FrameWatcher(int entry, QObject* parent)
+            : QObject(parent),
+              m_entry(entry) {}
+
+        auto eventFilter(QObject* watched, QEvent* event) -> bool override
+        {
+            const auto window = qobject_cast<QWindow*>(watched);
+
+            if (event->type() == QEvent::Expose && window && window->isExposed())
+            {
+                window->removeEventFilter(this);
+
+                // The frame has been flushed once the expose event is handled
+                QTimer::singleShot(0, this, [this] {
+                    StartupProfile::end(m_entry);
+                    StartupProfile::print();
+
+                    if (EventTrace::dump(EventTrace::dumpPath()))
+                    {
+                        QTextStream err(stderr, QIODevice::WriteOnly);
+                        err << "Trace written to " << EventTrace::dumpPath() << Qt::endl;
+                    }
+
+                    QCoreApplication::quit();
+                });
+            }
+
+            return false;
+        }
+
+    private:
+        const int m_entry;
+    };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+StartupProfile::Phase::Phase(const char* name)
+    : m_entry(begin(name)) {}
+
+// ---------------------------------------------------------------------------------------------- //
+
+StartupProfile::Phase::~Phase()
+{
+    end(m_entry);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto StartupProfile::begin(const char* name) -> int
+{
+    // Nothing is traced either, end() can't tell which phase to close without an entry
+    if (Entries.size() >= MaxEntries)
+        return -1;
+
+    EventTrace::begin(name);
+
+    const qint64 time = now();
+
+    if (Origin < 0)
+        Origin = time;
+
+    Entries << Entry { name, Depth++, time - Origin, -1 };
+
+    return Entries.size() - 1;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void StartupProfile::end(int entry)
+{
+    if (entry < 0)
+        return;
+
+    Entry& phase = Entries[entry];
+
+    EventTrace::end(phase.name);
+
+    phase.duration = now() - Origin - phase.start;
+    --Depth;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto StartupProfile::entries() -> QList<Entry>
+{
+    return Entries;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void StartupProfile::print()
+{
+    QTextStream out(stdout, QIODevice::WriteOnly);
+    out << "Phase\tDepth\tStart (ms)\tDuration (ms)" << Qt::endl;
+
+    for (const Entry& entry : Entries)
+    {
+        if (entry.duration < 0)
+            continue;
+
+        out << QString(2 * entry.depth, ' ') << entry.name << '\t' << entry.depth << '\t'
+            << QString::number(entry.start / 1e6, 'f', 2) << '\t'
+            << QString::number(entry.duration / 1e6, 'f', 2) << Qt::endl;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void StartupProfile::quitAfterFirstFrame(QWidget* window)
+{
+    const int entry = begin("first frame");
+
+    // Creates the native window if it doesn't exist yet
+    window->winId();
+    window->windowHandle()->installEventFilter(new FrameWatcher(entry, window));
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto StartupProfile::benchmark(const QStringList& arguments, int runs) -> int
+{
+    QStringList phases;
+    QHash<QString, QList<double>> durations;
+    QList<double> totals;
+
+    QTextStream out(stdout, QIODevice::WriteOnly);
+
+    for (int i = 0; i < runs; ++i)
+    {
+        // Every run is a cold start of a separate process
+        QElapsedTimer timer;
+        timer.start();
+
+        QProcess process;
+        process.start(QCoreApplication::applicationFilePath(),
+                      QStringList("--profile-startup") << arguments);
+
+        if (!process.waitForFinished(ChildTimeout) || process.exitCode() != 0)
+        {
+            qWarning() << "Startup run" << i + 1 << "failed:" << process.readAllStandardError();
+            return -1;
+        }
+
+        totals << timer.nsecsElapsed() / 1e6;
+
+        // Phases that occur more than once, e.g. one per daemon, are added up
+        QHash<QString, double> run;
+
+        for (const QByteArray& line : process.readAllStandardOutput().split('\n'))
+        {
+            const QList<QByteArray> fields = line.split('\t');
+            bool ok = false;
+
+            const double duration = fields.value(3).toDouble(&ok);
+
+            if (fields.size() != 4 || !ok)
+                continue;
+
+            const QString name = QString::fromUtf8(fields.at(0));
+
+            if (!phases.contains(name))
+                phases << name;
+
+            run[name] += duration;
+        }
+
+        for (auto it = run.cbegin(); it != run.cend(); ++it)
+            durations[it.key()] << it.value();
+
+        out << "Run " << i + 1 << ": " << QString::number(totals.last(), 'f', 1) << " ms"
+            << Qt::endl;
+    }
+
+    out << Qt::endl << "Phase\tMin (ms)\tMedian (ms)\tMax (ms)" << Qt::endl;
+
+    const auto printRow = [&out](const QString& name, const QList<double>& values) {
+        out << name << '\t'
+            << QString::number(*std::min_element(values.cbegin(), values.cend()), 'f', 2) << '\t'
+            << QString::number(median(values), 'f', 2) << '\t'
+            << QString::number(*std::max_element(values.cbegin(), values.cend()), 'f', 2)
+            << Qt::endl;
+    };
+
+    for (const QString& name : phases)
+        printRow(name, durations.value(name));
+
+    printRow("process", totals);
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------------------------- //
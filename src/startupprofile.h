@@ -0,0 +1,66 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef STARTUPPROFILE_H
+#define STARTUPPROFILE_H
+
+#include <QList>
+#include <QString>
+
+class QWidget;
+
+class StartupProfile
+{
+public:
+    class Phase
+    {
+    public:
+        explicit Phase(const char* name);
+        ~Phase();
+
+        Phase(const Phase&) = delete;
+        auto operator=(const Phase&) -> Phase& = delete;
+
+    private:
+        const int m_entry;
+    };
+
+    struct Entry
+    {
+        const char* name;
+        int depth;
+        qint64 start; // ns
+        qint64 duration; // ns, negative while running
+    };
+
+public:
+    static auto begin(const char* name) -> int;
+    static void end(int entry);
+
+    static auto entries() -> QList<Entry>;
+    static void print();
+
+    static void quitAfterFirstFrame(QWidget* window);
+
+    static auto benchmark(const QStringList& arguments, int runs) -> int;
+};
+
+#endif // STARTUPPROFILE_H
@@ -0,0 +1,275 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "trafficrecorder.h"
+
+#include <QDBusArgument>
+#include <QDBusVariant>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    QFile File;
+    QElapsedTimer Clock;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrafficRecorder::start(const QString& filename) -> bool
+{
+    Q_ASSERT(!File.isOpen());
+
+    File.setFileName(filename);
+
+    if (!File.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    Clock.start();
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrafficRecorder::isRecording() -> bool
+{
+    return File.isOpen();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrafficRecorder::recordCall(const QDBusMessage& method, const QDBusMessage& reply,
+                                 qint64 latency)
+{
+    if (!isRecording())
+        return;
+
+    QJsonObject entry = {
+        { "t", Clock.elapsed() - latency },
+        { "call", method.member() },
+        { "args", toJson(method.arguments()) },
+        { "ms", latency }
+    };
+
+    if (reply.type() == QDBusMessage::ReplyMessage)
+        entry.insert("reply", toJson(reply.arguments()));
+    else
+    {
+        entry.insert("error", reply.errorName());
+        entry.insert("message", reply.errorMessage());
+    }
+
+    write(entry);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrafficRecorder::recordSignal(const QString& name, const QVariantList& arguments)
+{
+    if (!isRecording())
+        return;
+
+    write({
+        { "t", Clock.elapsed() },
+        { "signal", name },
+        { "args", toJson(arguments) }
+    });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrafficRecorder::toJson(const QVariantList& arguments) -> QJsonArray
+{
+    QJsonArray values;
+
+    for (const QVariant& argument : arguments)
+        values << toJson(argument);
+
+    return values;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrafficRecorder::fromJson(const QJsonArray& arguments) -> QVariantList
+{
+    QVariantList values;
+
+    for (const QJsonValue& argument : arguments)
+        values << fromJson(argument.toObject());
+
+    return values;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrafficRecorder::toJson(const QVariant& value) -> QJsonObject
+{
+    // Keyed by the D-Bus signature, so the replay sends the same types
+    switch (value.userType())
+    {
+    case QMetaType::Bool:
+        return { { "b", value.toBool() } };
+
+    case QMetaType::Int:
+        return { { "i", value.toInt() } };
+
+    case QMetaType::UInt:
+        return { { "u", qint64(value.toUInt()) } };
+
+    case QMetaType::LongLong:
+        return { { "x", value.toLongLong() } };
+
+    case QMetaType::Double:
+        return { { "d", value.toDouble() } };
+
+    case QMetaType::QString:
+        return { { "s", value.toString() } };
+
+    case QMetaType::QStringList:
+        return { { "as", QJsonArray::fromStringList(value.toStringList()) } };
+
+    case QMetaType::QVariantMap:
+    {
+        const QVariantMap map = value.toMap();
+        QJsonObject fields;
+
+        for (auto it = map.cbegin(); it != map.cend(); ++it)
+            fields.insert(it.key(), toJson(it.value()));
+
+        return { { "a{sv}", fields } };
+    }
+
+    default:
+        break;
+    }
+
+    if (value.userType() == qMetaTypeId<QDBusVariant>())
+        return { { "v", toJson(value.value<QDBusVariant>().variant()) } };
+
+    if (value.userType() == qMetaTypeId<QDBusArgument>())
+    {
+        const QDBusArgument argument = value.value<QDBusArgument>();
+
+        // The daemon's only structures, like the device ID, consist of strings. Arguments that
+        // are being sent can't be read back, those are only needed to tell calls apart anyway.
+        if (argument.currentType() == QDBusArgument::StructureType)
+        {
+            QStringList fields;
+
+            argument.beginStructure();
+
+            while (!argument.atEnd())
+            {
+                QString field;
+                argument >> field;
+                fields << field;
+            }
+
+            argument.endStructure();
+
+            return { { "(s)", QJsonArray::fromStringList(fields) } };
+        }
+    }
+
+    return { { "?", QString::fromLatin1(value.typeName()) } };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrafficRecorder::fromJson(const QJsonObject& value) -> QVariant
+{
+    if (value.size() != 1)
+        return QVariant();
+
+    const QString type = value.constBegin().key();
+    const QJsonValue data = value.constBegin().value();
+
+    if (type == "b")
+        return data.toBool();
+
+    if (type == "i")
+        return data.toInt();
+
+    if (type == "u")
+        return uint(data.toInteger());
+
+    if (type == "x")
+        return qlonglong(data.toInteger());
+
+    if (type == "d")
+        return data.toDouble();
+
+    if (type == "s")
+        return data.toString();
+
+    if (type == "as")
+    {
+        QStringList strings;
+
+        for (const QJsonValue& string : data.toArray())
+            strings << string.toString();
+
+        return strings;
+    }
+
+    if (type == "a{sv}")
+    {
+        const QJsonObject fields = data.toObject();
+        QVariantMap map;
+
+        for (auto it = fields.constBegin(); it != fields.constEnd(); ++it)
+            map.insert(it.key(), fromJson(it.value().toObject()));
+
+        return map;
+    }
+
+    if (type == "v")
+        return QVariant::fromValue(QDBusVariant(fromJson(data.toObject())));
+
+    if (type == "(s)")
+    {
+        QDBusArgument structure;
+        structure.beginStructure();
+
+        for (const QJsonValue& field : data.toArray())
+            structure << field.toString();
+
+        structure.endStructure();
+
+        return QVariant::fromValue(structure);
+    }
+
+    return QVariant();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrafficRecorder::write(const QJsonObject& entry)
+{
+    // One line per entry, flushed right away so a crash doesn't take the interesting part along
+    File.write(QJsonDocument(entry).toJson(QJsonDocument::Compact) + '\n');
+    File.flush();
+}
+
+// ---------------------------------------------------------------------------------------------- //
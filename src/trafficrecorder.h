@@ -0,0 +1,48 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef TRAFFICRECORDER_H
+#define TRAFFICRECORDER_H
+
+#include <QDBusMessage>
+#include <QJsonArray>
+#include <QJsonObject>
+
+class TrafficRecorder
+{
+public:
+    static auto start(const QString& filename) -> bool;
+    static auto isRecording() -> bool;
+
+    static void recordCall(const QDBusMessage& method, const QDBusMessage& reply, qint64 latency);
+    static void recordSignal(const QString& name, const QVariantList& arguments = QVariantList());
+
+    static auto toJson(const QVariantList& arguments) -> QJsonArray;
+    static auto fromJson(const QJsonArray& arguments) -> QVariantList;
+
+private:
+    static auto toJson(const QVariant& value) -> QJsonObject;
+    static auto fromJson(const QJsonObject& value) -> QVariant;
+
+    static void write(const QJsonObject& entry);
+};
+
+#endif // TRAFFICRECORDER_H
@@ -0,0 +1,276 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "exception.h"
+#include "trafficrecorder.h"
+#include "trafficreplay.h"
+
+#include <QDBusError>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+
+#include <csignal>
+#include <sys/prctl.h>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr const char* ServiceName   = "net.sf.cdemu.CDEmuDaemon";
+    constexpr const char* PathName      = "/Daemon";
+    constexpr const char* InterfaceName = "net.sf.cdemu.CDEmuDaemon";
+
+    constexpr const char* ConnectionName = "kde_cdemu_replay";
+
+    constexpr int BusTimeout = 5000;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+TrafficReplay::TrafficReplay(QObject* parent)
+    : QDBusVirtualObject(parent),
+      m_signalTimer(this),
+      m_bus(this),
+      m_connection(ConnectionName)
+{
+    m_signalTimer.setSingleShot(true);
+    connect(&m_signalTimer, SIGNAL(timeout()), this, SLOT(emitSignals()));
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+TrafficReplay::~TrafficReplay()
+{
+    if (m_connection.isConnected())
+    {
+        m_connection.unregisterObject(PathName);
+        QDBusConnection::disconnectFromBus(ConnectionName);
+    }
+
+    if (m_bus.state() != QProcess::NotRunning)
+    {
+        m_bus.terminate();
+        m_bus.waitForFinished(BusTimeout);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrafficReplay::load(const QString& filename)
+{
+    QFile file(filename);
+
+    if (!file.open(QIODevice::ReadOnly))
+        throw Exception(Error::FileNotReadable);
+
+    while (!file.atEnd())
+    {
+        const QJsonObject entry = QJsonDocument::fromJson(file.readLine()).object();
+        const QJsonArray arguments = entry.value("args").toArray();
+
+        if (entry.contains("call"))
+        {
+            const QString member = entry.value("call").toString();
+
+            const Call call = {
+                TrafficRecorder::fromJson(entry.value("reply").toArray()),
+                entry.value("error").toString(),
+                entry.value("message").toString(),
+                entry.value("ms").toInteger()
+            };
+
+            m_calls[keyOf(member, arguments)].enqueue(call);
+
+            // Answers calls with arguments that never came up, like devices that didn't exist
+            if (!m_fallbacks.contains(member))
+                m_fallbacks.insert(member, call);
+
+            ++m_callCount;
+        }
+        else if (entry.contains("signal"))
+        {
+            m_signals << Signal {
+                entry.value("t").toInteger(),
+                entry.value("signal").toString(),
+                TrafficRecorder::fromJson(arguments)
+            };
+        }
+    }
+
+    if (m_callCount == 0 && m_signals.isEmpty())
+        throw Exception(Error::ReplayFailed);
+
+    std::stable_sort(m_signals.begin(), m_signals.end(), [](const Signal& a, const Signal& b) {
+        return a.time < b.time;
+    });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrafficReplay::start(double speed) -> QString
+{
+    Q_ASSERT(speed > 0);
+
+    // A bus of its own, so neither the real daemon nor other clients get in the way
+    m_bus.setProgram("dbus-daemon");
+    m_bus.setArguments({ "--session", "--nofork", "--print-address=1",
+                         "--address=unix:tmpdir=" + QDir::tempPath() });
+
+    // Doesn't outlive the replay when it's interrupted
+    m_bus.setChildProcessModifier([] { prctl(PR_SET_PDEATHSIG, SIGTERM); });
+
+    m_bus.start(QIODevice::ReadOnly);
+
+    if (!m_bus.waitForStarted(BusTimeout))
+        throw Exception(Error::ReplayFailed);
+
+    while (!m_bus.canReadLine())
+    {
+        if (!m_bus.waitForReadyRead(BusTimeout))
+            throw Exception(Error::ReplayFailed);
+    }
+
+    const QString address = QString::fromLocal8Bit(m_bus.readLine()).trimmed();
+
+    m_connection = QDBusConnection::connectToBus(address, ConnectionName);
+
+    if (!m_connection.isConnected() || !m_connection.registerService(ServiceName) ||
+        !m_connection.registerVirtualObject(PathName, this))
+    {
+        throw Exception(Error::ReplayFailed);
+    }
+
+    m_speed = speed;
+    m_clock.start();
+
+    emitSignals();
+
+    return address;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrafficReplay::callCount() const -> int
+{
+    return m_callCount;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrafficReplay::signalCount() const -> int
+{
+    return m_signals.size();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrafficReplay::introspect(const QString& path) const -> QString
+{
+    Q_UNUSED(path)
+
+    // Clients use the messages directly, nothing has to be discovered
+    return QString("<interface name=\"%1\"/>").arg(InterfaceName);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrafficReplay::handleMessage(const QDBusMessage& message, const QDBusConnection& connection)
+    -> bool
+{
+    if (message.type() != QDBusMessage::MethodCallMessage || message.interface() != InterfaceName)
+        return false;
+
+    const QString member = message.member();
+    const QString key = keyOf(member, TrafficRecorder::toJson(message.arguments()));
+
+    Call call;
+
+    // The recorded order first, then the last answer again, like for polled states
+    if (!m_calls.value(key).isEmpty())
+    {
+        call = m_calls[key].dequeue();
+        m_lastCalls.insert(key, call);
+    }
+    else if (m_lastCalls.contains(key))
+        call = m_lastCalls.value(key);
+    else if (m_fallbacks.contains(member))
+        call = m_fallbacks.value(member);
+    else
+    {
+        connection.send(message.createErrorReply(QDBusError::UnknownMethod, member));
+        return true;
+    }
+
+    const QDBusMessage reply = call.error.isEmpty()
+            ? message.createReply(call.reply)
+            : message.createErrorReply(call.error, call.message);
+
+    const qint64 now = m_clock.elapsed();
+    const qint64 due = std::max(now + qRound64(call.latency / m_speed), m_lastReply);
+
+    m_lastReply = due;
+
+    QTimer::singleShot(int(due - now), this, [connection, reply] {
+        connection.send(reply);
+    });
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrafficReplay::emitSignals()
+{
+    const qint64 now = m_clock.elapsed();
+
+    while (m_nextSignal < m_signals.size())
+    {
+        const Signal& next = m_signals.at(m_nextSignal);
+        const qint64 due = qRound64(next.time / m_speed);
+
+        if (due > now)
+        {
+            m_signalTimer.start(int(due - now));
+            return;
+        }
+
+        QDBusMessage message = QDBusMessage::createSignal(PathName, InterfaceName, next.name);
+        message.setArguments(next.arguments);
+
+        m_connection.send(message);
+        ++m_nextSignal;
+    }
+
+    emit signalsFinished();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrafficReplay::keyOf(const QString& member, const QJsonArray& arguments) -> QString
+{
+    const QByteArray json = QJsonDocument(arguments).toJson(QJsonDocument::Compact);
+    return member + ' ' + QString::fromUtf8(json);
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,97 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef TRAFFICREPLAY_H
+#define TRAFFICREPLAY_H
+
+#include <QDBusConnection>
+#include <QDBusVirtualObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonArray>
+#include <QProcess>
+#include <QQueue>
+#include <QTimer>
+
+class TrafficReplay : public QDBusVirtualObject
+{
+    Q_OBJECT
+
+public:
+    explicit TrafficReplay(QObject* parent = nullptr);
+    ~TrafficReplay() override;
+
+    void load(const QString& filename);
+    auto start(double speed = 1.0) -> QString;
+
+    auto callCount() const -> int;
+    auto signalCount() const -> int;
+
+    auto introspect(const QString& path) const -> QString override;
+    auto handleMessage(const QDBusMessage& message, const QDBusConnection& connection)
+        -> bool override;
+
+signals:
+    void signalsFinished();
+
+private slots:
+    void emitSignals();
+
+private:
+    struct Call
+    {
+        QVariantList reply;
+        QString error;
+        QString message;
+        qint64 latency;
+    };
+
+    struct Signal
+    {
+        qint64 time;
+        QString name;
+        QVariantList arguments;
+    };
+
+    static auto keyOf(const QString& member, const QJsonArray& arguments) -> QString;
+
+private:
+    // Recorded replies in order, by method and arguments
+    QHash<QString, QQueue<Call>> m_calls;
+    QHash<QString, Call> m_lastCalls;
+    QHash<QString, Call> m_fallbacks;
+    int m_callCount = 0;
+
+    QList<Signal> m_signals;
+    int m_nextSignal = 0;
+
+    double m_speed = 1.0;
+    QElapsedTimer m_clock;
+    QTimer m_signalTimer;
+
+    // The daemon handles one call after the other, so replies never overtake each other
+    qint64 m_lastReply = 0;
+
+    QProcess m_bus;
+    QDBusConnection m_connection;
+};
+
+#endif // TRAFFICREPLAY_H
@@ -0,0 +1,612 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "archiveextractor.h"
+#include "discset.h"
+#include "hotset.h"
+#include "imagecache.h"
+#include "mainwindow.h"
+#include "messagebox.h"
+#include "mountjournal.h"
+#include "ramstaging.h"
+#include "startupprofile.h"
+#include "trayicon.h"
+#include "watchfolder.h"
+
+#include <KHelpMenu>
+#include <KLocalizedString>
+#include <KStatusNotifierItem>
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMenu>
+#include <QSettings>
+#include <QThread>
+#include <QTimer>
+
+#include <memory>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr const char* ShowTrayIconKey = "showTrayIcon";
+    constexpr const char* LowFootprintKey = "lowFootprintTray";
+
+    // Residency changes slowly, and sampling walks the page tables of every image
+    constexpr int HotSetInterval = 30000;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+TrayIcon::TrayIcon(const QList<const CDEmu*>& endpoints, Mode mode, QObject* parent)
+    : QObject(parent),
+      m_endpoints(endpoints),
+      m_mode(mode)
+{
+    {
+        const StartupProfile::Phase phase("KHelpMenu");
+        m_helpMenu = new KHelpMenu();
+    }
+
+    // The window still needs one to show, it just isn't started
+    m_watchFolder = new WatchFolder(m_endpoints, this);
+
+    m_hotSetTimer = new QTimer(this);
+    m_hotSetTimer->setInterval(HotSetInterval);
+    connect(m_hotSetTimer, SIGNAL(timeout()), this, SLOT(sampleHotSets()));
+
+    // Running next to the actual instance, which takes care of all of the below
+    if (isPassive())
+        return;
+
+    // Without a window, someone still has to keep track of the devices
+    for (const CDEmu* cdemu : m_endpoints)
+    {
+        connect(cdemu, SIGNAL(daemonChanged(bool)), this, SLOT(onDaemonChanged(bool)));
+        connect(cdemu, SIGNAL(deviceChanged(int)), this, SLOT(onDeviceChanged(int)));
+    }
+
+    setVisible(isEnabled());
+
+    // Keeps mounting while the window is released
+    if (!WatchFolder::folder().isEmpty() && !m_watchFolder->start(WatchFolder::folder()))
+        qDebug() << "Unable to watch" << WatchFolder::folder();
+
+    setHotSetSampling(HotSet::isEnabled());
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+TrayIcon::~TrayIcon()
+{
+    if (m_hotSetThread)
+    {
+        m_hotSetThread->wait();
+        delete m_hotSetThread;
+    }
+
+    delete m_window.data();
+    delete m_trayIcon;
+    delete m_helpMenu;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrayIcon::setVisible(bool visible)
+{
+    if (visible)
+    {
+        if (!m_trayIcon)
+        {
+            const StartupProfile::Phase phase("KStatusNotifierItem");
+
+            // Not associated with the window, which may come and go
+            m_trayIcon = new KStatusNotifierItem(this);
+            m_trayIcon->setIconByName("media-optical");
+            m_trayIcon->setCategory(KStatusNotifierItem::ApplicationStatus);
+            m_trayIcon->setStatus(KStatusNotifierItem::Active);
+            m_trayIcon->setToolTip("media-optical", "KDE CDEmu Manager", "");
+
+            connect(m_trayIcon, SIGNAL(activateRequested(bool,QPoint)),
+                    this,       SLOT(onActivateRequested()));
+
+            // Only built when opened
+            m_deviceMenu = new QMenu(i18n("Devices"), m_trayIcon->contextMenu());
+            m_deviceMenu->setIcon(QIcon::fromTheme("media-optical"));
+            connect(m_deviceMenu, SIGNAL(aboutToShow()), this, SLOT(updateDeviceMenu()));
+
+            m_discSetMenu = new QMenu(i18n("Disc Sets"), m_trayIcon->contextMenu());
+            m_discSetMenu->setIcon(QIcon::fromTheme("media-optical-mixed-cd"));
+            connect(m_discSetMenu, SIGNAL(aboutToShow()), this, SLOT(updateDiscSetMenu()));
+
+            m_trayIcon->contextMenu()->addMenu(m_deviceMenu);
+            m_trayIcon->contextMenu()->addMenu(m_discSetMenu);
+            m_trayIcon->contextMenu()->addMenu(m_helpMenu->menu());
+        }
+    }
+    else
+    {
+        delete m_trayIcon;
+        m_trayIcon = nullptr;
+        m_deviceMenu = nullptr;
+        m_discSetMenu = nullptr;
+    }
+
+    QSettings settings;
+    settings.setValue(ShowTrayIconKey, visible);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrayIcon::isVisible() const -> bool
+{
+    return m_trayIcon != nullptr;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrayIcon::window() const -> MainWindow*
+{
+    return m_window;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrayIcon::showWindow() -> MainWindow*
+{
+    if (!m_window)
+    {
+        const StartupProfile::Phase phase("MainWindow");
+
+        // Starts out with the device list saved by the previous window
+        m_window = new MainWindow(m_endpoints, *this);
+        connect(m_window, SIGNAL(destroyed()), this, SLOT(onWindowDestroyed()));
+    }
+
+    const StartupProfile::Phase phase("show");
+
+    m_window->show();
+    m_window->raise();
+    m_window->activateWindow();
+
+    return m_window;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrayIcon::releaseWindow()
+{
+    delete m_window.data();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrayIcon::watchFolder() const -> WatchFolder&
+{
+    return *m_watchFolder;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrayIcon::isPassive() const -> bool
+{
+    return m_mode == Mode::Passive;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrayIcon::setHotSetSampling(bool enabled)
+{
+    if (enabled && !isPassive())
+        m_hotSetTimer->start();
+    else
+        m_hotSetTimer->stop();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrayIcon::isEnabled() -> bool
+{
+    QSettings settings;
+    return settings.value(ShowTrayIconKey, true).toBool();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto TrayIcon::isLowFootprint() -> bool
+{
+    QSettings settings;
+    return settings.value(LowFootprintKey, false).toBool();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrayIcon::setLowFootprint(bool enabled)
+{
+    QSettings settings;
+    settings.setValue(LowFootprintKey, enabled);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrayIcon::onActivateRequested()
+{
+    // Closing deletes the window in low footprint mode
+    if (m_window && m_window->isVisible())
+        m_window->close();
+    else
+        showWindow();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrayIcon::onDaemonChanged(bool running)
+{
+    const auto cdemu = qobject_cast<const CDEmu*>(sender());
+
+    if (!cdemu || !cdemu->address().isEmpty())
+        return;
+
+    // The window takes care of restoring while it exists
+    if (running && m_daemonLost && !m_window && MountJournal::isRestoreEnabled())
+    {
+        try {
+            MountJournal::restore(*cdemu);
+        }
+        catch (const Exception& e) {
+            qDebug() << "Unable to restore mounts:" << e.what();
+        }
+    }
+
+    m_daemonLost = !running;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrayIcon::onDeviceChanged(int index)
+{
+    const auto cdemu = qobject_cast<const CDEmu*>(sender());
+
+    // The window takes care of this while it exists
+    if (!cdemu || m_window)
+        return;
+
+    // Nothing here waits for the daemon, a removed device has no status to record
+    if (cdemu->address().isEmpty())
+    {
+        cdemu->requestStatus(index, OperationScheduler::Interactive, this,
+                             [index](const QDBusMessage& reply) {
+            if (reply.type() == QDBusMessage::ReplyMessage)
+                MountJournal::recordState(index, CDEmu::toStatus(reply).fileName);
+        });
+    }
+
+    if (!RamStaging::hasStagedImages() && !ArchiveExtractor::hasExtractedImages())
+        return;
+
+    // One round of status calls for both
+    requestLoadedFiles([](bool answered, const QStringList& loadedFiles) {
+        // A daemon that didn't answer may still be using any of them
+        if (!answered)
+            return;
+
+        if (RamStaging::hasStagedImages())
+            RamStaging::release(loadedFiles);
+
+        if (ArchiveExtractor::hasExtractedImages())
+            ArchiveExtractor::release(loadedFiles);
+    });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrayIcon::requestLoadedFiles(const LoadedFilesCallback& callback)
+{
+    QList<const CDEmu*> running;
+
+    for (const CDEmu* cdemu : m_endpoints)
+    {
+        if (cdemu->isDaemonRunning())
+            running << cdemu;
+    }
+
+    if (running.isEmpty())
+    {
+        callback(true, {});
+        return;
+    }
+
+    // The callback runs once the last daemon has answered
+    auto loadedFiles = std::make_shared<QStringList>();
+    auto pending = std::make_shared<int>(running.size());
+    auto answered = std::make_shared<bool>(true);
+
+    for (const CDEmu* cdemu : std::as_const(running))
+    {
+        cdemu->requestStatuses(this, [callback, loadedFiles, pending, answered](
+                                             bool complete, const QList<CDEmu::Status>& statuses) {
+            *answered &= complete;
+
+            for (const CDEmu::Status& status : statuses)
+            {
+                if (status.loaded)
+                    *loadedFiles << status.fileName;
+            }
+
+            if (--*pending == 0)
+                callback(*answered, *loadedFiles);
+        });
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrayIcon::onWindowDestroyed()
+{
+#ifdef __GLIBC__
+    // Hand the memory of the widget tree back to the system once it's completely gone
+    QTimer::singleShot(0, this, [] { malloc_trim(0); });
+#endif
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrayIcon::sampleHotSets()
+{
+    // A round still under way covers this one as well
+    if (m_hotSetPending || (m_hotSetThread && m_hotSetThread->isRunning()))
+        return;
+
+    m_hotSetPending = true;
+
+    // Nothing here waits for the daemon, the files are learned once the last one has answered
+    requestLoadedFiles([this](bool answered, const QStringList& loadedFiles) {
+        m_hotSetPending = false;
+
+        // Images missing from the list would have their baselines forgotten
+        if (!answered)
+            return;
+
+        m_hotSetFiles = loadedFiles;
+        learnHotSets();
+    });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrayIcon::learnHotSets()
+{
+    const QStringList loadedFiles = m_hotSetFiles;
+    QStringList filenames;
+
+    for (const QString& filename : loadedFiles)
+    {
+        // Neither the copy in memory nor the one extracted for this mount outlives it
+        if (!RamStaging::isStaged(filename) && !ArchiveExtractor::isExtracted(filename))
+            filenames << filename;
+    }
+
+    delete m_hotSetThread;
+
+    // Sampling maps every image and walks its page tables, which is no work for the GUI thread
+    m_hotSetThread = QThread::create([this, loadedFiles, filenames] {
+        HotSet::forget(loadedFiles);
+
+        for (const QString& filename : filenames)
+        {
+            const HotSet::Statistics statistics = HotSet::learn(filename);
+
+            if (statistics.size > 0 || statistics.unknown > 0)
+            {
+                emit hotSetLearned(filename, statistics.size, statistics.hitRate,
+                                   statistics.unknown);
+            }
+        }
+    });
+
+    m_hotSetThread->start(QThread::LowPriority);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrayIcon::updateDeviceMenu()
+{
+    // Shown right away with what was last known, filled in as the daemons answer
+    fillDeviceMenu();
+
+    for (const CDEmu* cdemu : m_endpoints)
+    {
+        if (!cdemu->isDaemonRunning())
+            continue;
+
+        cdemu->requestStatuses(this, [this, cdemu](bool answered,
+                                                   const QList<CDEmu::Status>& statuses) {
+            if (answered)
+                m_deviceStatuses.insert(cdemu, statuses);
+            else
+                m_deviceStatuses.remove(cdemu);
+
+            if (m_deviceMenu)
+                fillDeviceMenu();
+        });
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrayIcon::fillDeviceMenu()
+{
+    Q_ASSERT(m_deviceMenu != nullptr);
+
+    m_deviceMenu->clear();
+
+    for (const CDEmu* cdemu : m_endpoints)
+    {
+        if (m_endpoints.size() > 1)
+            m_deviceMenu->addSection(cdemu->displayName());
+
+        if (!cdemu->isDaemonRunning())
+            continue;
+
+        if (!m_deviceStatuses.contains(cdemu))
+        {
+            m_deviceMenu->addAction(cdemu->isResponsive() ? i18n("Updating...")
+                                                          : i18n("Not responding"))
+                    ->setEnabled(false);
+            continue;
+        }
+
+        const QList<CDEmu::Status> statuses = m_deviceStatuses.value(cdemu);
+
+        for (int i = 0; i < statuses.size(); ++i)
+        {
+            if (statuses.at(i).loaded)
+            {
+                // Show the image the user selected, not a cached, staged or extracted copy
+                const QString loaded = statuses.at(i).fileName;
+                const QString filename = ArchiveExtractor::originalPath(
+                        ImageCache::originalPath(RamStaging::originalPath(loaded)));
+
+                QAction* action = m_deviceMenu->addAction(QIcon::fromTheme("media-eject"),
+                                                          i18n("Eject %1: %2", i,
+                                                               QFileInfo(filename).fileName()));
+
+                connect(action, &QAction::triggered, this, [this, cdemu, i] {
+                    cdemu->requestUnmount(i, this, [](const QDBusMessage& reply) {
+                        const QString error = CDEmu::errorOf(reply);
+
+                        if (!error.isEmpty())
+                            MessageBox::error(error);
+                    }, OperationScheduler::Normal);
+                });
+            }
+            else
+            {
+                QAction* action = m_deviceMenu->addAction(QIcon::fromTheme("document-open"),
+                                                          i18n("Mount on %1...", i));
+
+                // Verification, caching and history are handled by the window
+                connect(action, &QAction::triggered, this, [this, cdemu, i] {
+                    showWindow()->mountDevice(*cdemu, i);
+                });
+            }
+        }
+    }
+
+    if (m_deviceMenu->isEmpty())
+        m_deviceMenu->addAction(i18n("No devices"))->setEnabled(false);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void TrayIcon::updateDiscSetMenu()
+{
+    Q_ASSERT(m_discSetMenu != nullptr);
+
+    m_discSetMenu->clear();
+
+    for (const QString& name : DiscSet::names())
+    {
+        DiscSet set;
+
+        try {
+            set = DiscSet::load(name);
+        }
+        catch (const Exception&) {
+            continue;
+        }
+
+        QMenu* menu = m_discSetMenu->addMenu(i18n("%1 (disc %2 of %3)", name, set.current() + 1,
+                                                  set.images().size()));
+
+        // Swaps discs in the drive the set is bound to, the gap is what the guest notices
+        const auto insert = [this, name](int disc) {
+            try {
+                DiscSet set = DiscSet::load(name);
+
+                const CDEmu* cdemu = &set.endpoint(m_endpoints);
+                const int index = set.device();
+
+                // Starts over after the last disc
+                if (disc < 0)
+                    disc = (set.current() + 1) % set.images().size();
+
+                QElapsedTimer timer;
+                timer.start();
+
+                cdemu->requestSwap(index, set.images().at(disc), this,
+                                   [this, set, cdemu, index, disc, timer](
+                                           const QDBusMessage& reply) mutable {
+                    const QString error = CDEmu::errorOf(reply);
+
+                    if (!error.isEmpty())
+                    {
+                        MessageBox::error(error);
+                        return;
+                    }
+
+                    set.setInserted(*cdemu, index, disc);
+
+                    m_trayIcon->showMessage(set.name(),
+                                            i18n("Disc %1 of %2 inserted into device %3 in %4 ms",
+                                                 disc + 1, set.images().size(), index,
+                                                 timer.elapsed()),
+                                            "media-optical", 3000);
+                });
+            }
+            catch (const Exception& e) {
+                MessageBox::error(e.what());
+            }
+        };
+
+        QAction* next = menu->addAction(QIcon::fromTheme("go-next"), i18n("Next Disc"));
+        connect(next, &QAction::triggered, this, [insert] { insert(-1); });
+
+        menu->addSeparator();
+
+        const QStringList images = set.images();
+
+        for (int i = 0; i < images.size(); ++i)
+        {
+            QAction* action = menu->addAction(i18n("Disc %1: %2", i + 1,
+                                                   QFileInfo(images.at(i)).fileName()));
+            action->setCheckable(true);
+            action->setChecked(i == set.current());
+
+            connect(action, &QAction::triggered, this, [insert, i] { insert(i); });
+        }
+
+        menu->addSeparator();
+
+        QAction* forget = menu->addAction(QIcon::fromTheme("edit-delete"), i18n("Forget Disc Set"));
+        connect(forget, &QAction::triggered, this, [name] { DiscSet::remove(name); });
+    }
+
+    if (m_discSetMenu->isEmpty())
+        m_discSetMenu->addAction(i18n("No disc sets"))->setEnabled(false);
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,119 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef TRAYICON_H
+#define TRAYICON_H
+
+#include "cdemu.h"
+
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+
+class KHelpMenu;
+class KStatusNotifierItem;
+class MainWindow;
+class QMenu;
+class QThread;
+class QTimer;
+class WatchFolder;
+
+class TrayIcon : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Mode
+    {
+        Normal,
+        Passive // Only manages the window, nothing is mounted, restored or saved
+    };
+
+public:
+    TrayIcon(const QList<const CDEmu*>& endpoints, Mode mode = Mode::Normal,
+             QObject* parent = nullptr);
+    ~TrayIcon() override;
+
+    void setVisible(bool visible);
+    auto isVisible() const -> bool;
+
+    auto window() const -> MainWindow*;
+    auto showWindow() -> MainWindow*;
+    void releaseWindow();
+
+    auto watchFolder() const -> WatchFolder&;
+
+    auto isPassive() const -> bool;
+
+    void setHotSetSampling(bool enabled);
+
+    static auto isEnabled() -> bool;
+
+    static auto isLowFootprint() -> bool;
+    static void setLowFootprint(bool enabled);
+
+signals:
+    void hotSetLearned(const QString& filename, qint64 size, int hitRate, qint64 unknown);
+
+private slots:
+    void onActivateRequested();
+    void onDaemonChanged(bool running);
+    void onDeviceChanged(int index);
+    void onWindowDestroyed();
+
+    void sampleHotSets();
+    void learnHotSets();
+
+    void updateDeviceMenu();
+    void updateDiscSetMenu();
+
+private:
+    using LoadedFilesCallback = std::function<void(bool answered, const QStringList& files)>;
+
+    void requestLoadedFiles(const LoadedFilesCallback& callback);
+    void fillDeviceMenu();
+
+private:
+    const QList<const CDEmu*> m_endpoints;
+    const Mode m_mode;
+
+    QPointer<MainWindow> m_window;
+
+    bool m_daemonLost = false;
+
+    KHelpMenu* m_helpMenu = nullptr;
+    KStatusNotifierItem* m_trayIcon = nullptr;
+    QMenu* m_deviceMenu = nullptr;
+    QMenu* m_discSetMenu = nullptr;
+
+    WatchFolder* m_watchFolder = nullptr;
+    QTimer* m_hotSetTimer = nullptr;
+    QThread* m_hotSetThread = nullptr;
+
+    // Loaded files collected for the next round of sampling
+    QStringList m_hotSetFiles;
+    bool m_hotSetPending = false;
+
+    // What the device menu shows until the daemons have answered
+    QHash<const CDEmu*, QList<CDEmu::Status>> m_deviceStatuses;
+};
+
+#endif // TRAYICON_H
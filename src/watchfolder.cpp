@@ -0,0 +1,505 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#include "imagefile.h"
+#include "imageverifier.h"
+#include "watchfolder.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QSettings>
+#include <QSocketNotifier>
+
+#include <algorithm>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr const char* WatchFolderKey = "watchFolder";
+    constexpr const char* ConcurrencyKey = "watchFolderConcurrency";
+
+    constexpr int DefaultConcurrency = 4;
+
+    // Writers may close and reopen a file a few times, e.g. when copying with a progress dialog
+    constexpr int SettleDelay = 250;
+
+    constexpr uint32_t WatchEvents = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM |
+                                     IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+WatchFolder::WatchFolder(const QList<const CDEmu*>& endpoints, QObject* parent)
+    : QObject(parent),
+      m_endpoints(endpoints)
+{
+    m_clock.start();
+
+    m_settleTimer.setSingleShot(true);
+    m_settleTimer.setInterval(SettleDelay);
+    connect(&m_settleTimer, SIGNAL(timeout()), this, SLOT(onSettled()));
+
+    for (const CDEmu* cdemu : m_endpoints)
+        connect(cdemu, SIGNAL(daemonChanged(bool)), this, SLOT(onDaemonChanged(bool)));
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+WatchFolder::~WatchFolder()
+{
+    stop();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto WatchFolder::start(const QString& path) -> bool
+{
+    stop();
+
+    m_descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (m_descriptor < 0)
+        return false;
+
+    if (inotify_add_watch(m_descriptor, QFile::encodeName(path).constData(), WatchEvents) < 0)
+    {
+        close(m_descriptor);
+        m_descriptor = -1;
+        return false;
+    }
+
+    m_path = QDir(path).absolutePath();
+
+    m_notifier = new QSocketNotifier(m_descriptor, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &WatchFolder::onNotify);
+
+    // Images that were there before are mounted right away
+    scan();
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void WatchFolder::stop()
+{
+    if (m_descriptor < 0)
+        return;
+
+    delete m_notifier;
+    m_notifier = nullptr;
+
+    close(m_descriptor);
+    m_descriptor = -1;
+
+    m_path.clear();
+
+    // Mounted images stay where they are, but aren't released anymore
+    m_settleTimer.stop();
+    m_pending.clear();
+    m_queue.clear();
+    m_inFlight.clear();
+    m_mounted.clear();
+    m_free.clear();
+
+    emit statisticsChanged();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto WatchFolder::isRunning() const -> bool
+{
+    return m_descriptor >= 0;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto WatchFolder::path() const -> QString
+{
+    return m_path;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto WatchFolder::statistics() const -> Statistics
+{
+    return {
+        m_queue.size(),
+        m_inFlight.size(),
+        m_mounted.size(),
+        m_failed,
+        static_cast<int>(m_lastLatency),
+        m_mountCount > 0 ? static_cast<int>(m_totalLatency / m_mountCount) : 0
+    };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto WatchFolder::folder() -> QString
+{
+    QSettings settings;
+    return settings.value(WatchFolderKey).toString();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void WatchFolder::setFolder(const QString& path)
+{
+    QSettings settings;
+    settings.setValue(WatchFolderKey, path);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto WatchFolder::concurrency() -> int
+{
+    QSettings settings;
+    return qMax(1, settings.value(ConcurrencyKey, DefaultConcurrency).toInt());
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void WatchFolder::onNotify()
+{
+    alignas(inotify_event) char buffer[4096];
+
+    bool overflow = false;
+    bool lost = false;
+
+    const QDir dir(m_path);
+
+    for (;;)
+    {
+        const ssize_t length = read(m_descriptor, buffer, sizeof(buffer));
+
+        if (length <= 0)
+            break;
+
+        for (const char* p = buffer; p < buffer + length;)
+        {
+            const auto event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+                overflow = true;
+            else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+                lost = true;
+            else if (event->len > 0)
+            {
+                const QString filename = dir.absoluteFilePath(QFile::decodeName(event->name));
+
+                // Only complete files show up here, nothing is read while it's still being written
+                if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                    m_pending.insert(filename, m_clock.elapsed());
+                else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                {
+                    m_pending.remove(filename);
+                    release(filename);
+                }
+            }
+        }
+    }
+
+    if (lost)
+    {
+        qWarning() << "Watched folder" << m_path << "is gone";
+        stop();
+        return;
+    }
+
+    // Some events were dropped, so the directory has to be compared with what's known
+    if (overflow)
+        scan();
+
+    if (!m_pending.isEmpty() && !m_settleTimer.isActive())
+        m_settleTimer.start();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void WatchFolder::onSettled()
+{
+    const qint64 now = m_clock.elapsed();
+
+    for (auto it = m_pending.begin(); it != m_pending.end();)
+    {
+        if (now - it.value() < SettleDelay)
+        {
+            ++it;
+            continue;
+        }
+
+        const QString filename = it.key();
+        it = m_pending.erase(it);
+
+        // Rewritten in place, so the old contents have to go first
+        if (m_mounted.contains(filename))
+            release(filename);
+
+        if (m_queue.contains(filename) || m_inFlight.contains(filename))
+            continue;
+
+        if (ImageFile::isImage(filename))
+            enqueue(filename);
+    }
+
+    if (!m_pending.isEmpty())
+        m_settleTimer.start();
+
+    pump();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void WatchFolder::onDaemonChanged(bool running)
+{
+    const auto cdemu = qobject_cast<const CDEmu*>(sender());
+
+    if (!cdemu || !isRunning())
+        return;
+
+    // A restarted daemon comes up with empty devices
+    for (auto it = m_mounted.begin(); it != m_mounted.end();)
+    {
+        if (it.value().cdemu == cdemu)
+            it = m_mounted.erase(it);
+        else
+            ++it;
+    }
+
+    m_free.clear();
+
+    if (running)
+        scan();
+    else
+        emit statisticsChanged();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void WatchFolder::scan()
+{
+    const qint64 settled = m_clock.elapsed() - SettleDelay;
+
+    for (const QFileInfo& info : QDir(m_path).entryInfoList(QDir::Files))
+    {
+        const QString filename = info.absoluteFilePath();
+
+        if (!m_mounted.contains(filename) && !m_inFlight.contains(filename))
+            m_pending.insert(filename, settled);
+    }
+
+    onSettled();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void WatchFolder::enqueue(const QString& filename)
+{
+    if (ImageVerifier::isRequired() && !ImageVerifier::isVerified(filename))
+    {
+        ++m_failed;
+        emit mountFailed(filename, Exception(Error::ImageNotVerified).what());
+        return;
+    }
+
+    m_queue << filename;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void WatchFolder::release(const QString& filename)
+{
+    m_queue.removeAll(filename);
+
+    // Images that are still being mounted are released once the reply arrives
+    if (!m_mounted.contains(filename))
+    {
+        emit statisticsChanged();
+        return;
+    }
+
+    const Device device = m_mounted.take(filename);
+
+    try {
+        // The user may have put something else into the device in the meantime
+        if (device.cdemu->getFileName(device.index) == filename)
+        {
+            device.cdemu->requestUnmount(device.index);
+
+            // Requests are handled in order, so the device can be reused right away
+            m_free << device;
+        }
+    }
+    catch (const Exception& e) {
+        qDebug() << "Unable to release" << filename << e.what();
+    }
+
+    emit imageReleased(filename, device.index);
+    emit statisticsChanged();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void WatchFolder::pump()
+{
+    const int limit = concurrency();
+
+    while (!m_queue.isEmpty() && m_inFlight.size() < limit)
+    {
+        const QString filename = m_queue.takeFirst();
+        Device device = { nullptr, -1 };
+
+        try {
+            device = takeFreeDevice();
+        }
+        catch (const Exception& e) {
+            // Waits for a daemon to come up, anything else is a failure of this image
+            if (!std::any_of(m_endpoints.cbegin(), m_endpoints.cend(),
+                             [](const CDEmu* cdemu) { return cdemu->isDaemonRunning(); }))
+            {
+                m_queue.prepend(filename);
+                break;
+            }
+
+            ++m_failed;
+            emit mountFailed(filename, e.what());
+            continue;
+        }
+
+        m_inFlight.insert(filename, device);
+
+        QElapsedTimer timer;
+        timer.start();
+
+        // The daemon's scheduler decides how many of these actually go out at once
+        device.cdemu->requestMount(filename, device.index, this,
+                                   [this, filename, device, timer](const QDBusMessage& reply) {
+            finishMount(filename, device, reply, timer.elapsed());
+        });
+    }
+
+    emit statisticsChanged();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto WatchFolder::takeFreeDevice() -> Device
+{
+    if (m_free.isEmpty())
+        refreshFreeDevices();
+
+    if (!m_free.isEmpty())
+        return m_free.takeFirst();
+
+    // Every device is busy, so one more is added where there's most room
+    const CDEmu* cdemu = CDEmu::mostAvailable(m_endpoints);
+    return { cdemu, cdemu->addDevice() };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void WatchFolder::refreshFreeDevices()
+{
+    QList<QList<Device>> candidates;
+
+    for (const CDEmu* cdemu : m_endpoints)
+    {
+        // One that hangs would hold up mounting on all others
+        if (!cdemu->isDaemonRunning() || !cdemu->isResponsive())
+            continue;
+
+        QList<int> reserved;
+
+        for (const Device& device : m_inFlight)
+        {
+            if (device.cdemu == cdemu)
+                reserved << device.index;
+        }
+
+        const QList<CDEmu::Status> statuses = cdemu->getStatuses();
+        QList<Device> devices;
+
+        for (int i = 0; i < statuses.size(); ++i)
+        {
+            if (!statuses.at(i).loaded && !reserved.contains(i))
+                devices << Device { cdemu, i };
+        }
+
+        candidates << devices;
+    }
+
+    // Interleaved, so that consecutive images are spread over all daemons
+    for (int i = 0; !candidates.isEmpty(); ++i)
+    {
+        for (auto it = candidates.begin(); it != candidates.end();)
+        {
+            if (i < it->size())
+            {
+                m_free << it->at(i);
+                ++it;
+            }
+            else
+                it = candidates.erase(it);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void WatchFolder::finishMount(const QString& filename, const Device& device,
+                              const QDBusMessage& reply, qint64 latency)
+{
+    // Stopped watching in the meantime
+    if (m_inFlight.remove(filename) == 0)
+        return;
+
+    if (reply.type() == QDBusMessage::ErrorMessage)
+    {
+        // Somebody else may be using the devices, so their states are looked up again
+        m_free.clear();
+
+        ++m_failed;
+        emit mountFailed(filename, reply.errorMessage());
+    }
+    else
+    {
+        m_mounted.insert(filename, device);
+
+        ++m_mountCount;
+        m_lastLatency = latency;
+        m_totalLatency += latency;
+
+        emit imageMounted(filename, device.index, static_cast<int>(latency));
+
+        // Removed before the daemon got to it
+        if (!QFile::exists(filename))
+            release(filename);
+    }
+
+    pump();
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,121 @@
+/****************************************************************************
+ *                                                                          *
+ *   This file is part of KDE CDEmu Manager.                                *
+ *                                                                          *
+ *   Copyright (C) 2009-2024 by Marcel Hasler <mahasler@gmail.com>          *
+ *                                                                          *
+ *   This program is free software; you can redistribute it and/or modify   *
+ *   it under the terms of the GNU General Public License as published by   *
+ *   the Free Software Foundation, either version 3 of the License, or      *
+ *   (at your option) any later version.                                    *
+ *                                                                          *
+ *   This program is distributed in the hope that it will be useful,        *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *   GNU General Public License for more details.                           *
+ *                                                                          *
+ *   You should have received a copy of the GNU General Public License      *
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef WATCHFOLDER_H
+#define WATCHFOLDER_H
+
+#include "cdemu.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+
+class QSocketNotifier;
+
+class WatchFolder : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Statistics
+    {
+        int queued;
+        int inFlight;
+        int mounted;
+        int failed;
+        int lastLatency;
+        int averageLatency;
+    };
+
+public:
+    WatchFolder(const QList<const CDEmu*>& endpoints, QObject* parent = nullptr);
+    ~WatchFolder() override;
+
+    auto start(const QString& path) -> bool;
+    void stop();
+
+    auto isRunning() const -> bool;
+    auto path() const -> QString;
+
+    auto statistics() const -> Statistics;
+
+    static auto folder() -> QString;
+    static void setFolder(const QString& path);
+
+    static auto concurrency() -> int;
+
+signals:
+    void imageMounted(const QString& filename, int index, int latency);
+    void imageReleased(const QString& filename, int index);
+    void mountFailed(const QString& filename, const QString& reason);
+    void statisticsChanged();
+
+private slots:
+    void onNotify();
+    void onSettled();
+    void onDaemonChanged(bool running);
+
+private:
+    struct Device
+    {
+        const CDEmu* cdemu;
+        int index;
+    };
+
+private:
+    void scan();
+
+    void enqueue(const QString& filename);
+    void release(const QString& filename);
+    void pump();
+
+    auto takeFreeDevice() -> Device;
+    void refreshFreeDevices();
+
+    void finishMount(const QString& filename, const Device& device, const QDBusMessage& reply,
+                     qint64 latency);
+
+private:
+    const QList<const CDEmu*> m_endpoints;
+
+    QString m_path;
+    int m_descriptor = -1;
+    QSocketNotifier* m_notifier = nullptr;
+
+    // Files that were written recently, they're mounted once they settle
+    QHash<QString, qint64> m_pending;
+    QTimer m_settleTimer;
+    QElapsedTimer m_clock;
+
+    QStringList m_queue;
+    QHash<QString, Device> m_inFlight;
+    QHash<QString, Device> m_mounted;
+    QList<Device> m_free;
+
+    int m_failed = 0;
+    int m_mountCount = 0;
+    qint64 m_lastLatency = 0;
+    qint64 m_totalLatency = 0;
+};
+
+#endif // WATCHFOLDER_H